@@ -6,8 +6,41 @@
 */
 
 #include <Arduino.h>
+#include <EEPROM.h>
+#include <util/crc16.h>
 #include "Const.h"
+#include "Chips.h"
 #include "SRHelper.h"
+#include "RLEHelper.h"
+#include "DiagHelper.h"
+#include "AT28C.h"
+
+//******************************************************************************************************************//
+//* Profilo di temporizzazione in uso, il valore iniziale corrisponde alle attese di 1 us originali
+//******************************************************************************************************************//
+TimingProfile timing = { 1, 1, 1, 1 };
+
+//******************************************************************************************************************//
+//* Attesa di temporizzazione del bus
+//******************************************************************************************************************//
+inline void busDelay(byte us)
+{
+  if (us > 0) {
+    delayMicroseconds(us);
+  }
+}
+
+//******************************************************************************************************************//
+//* Descrittore di una memoria della tabella Chips.h, i parametri sono costanti di compilazione:
+//* i motori istanziati per ogni memoria hanno cicli di pagina a lunghezza fissa e limiti già risolti
+//******************************************************************************************************************//
+template <unsigned int SIZE, byte PAGE, bool SDP, byte TWC>
+struct ChipDescriptor {
+  static constexpr unsigned int size = SIZE;
+  static constexpr byte pageSize = PAGE;
+  static constexpr bool sdp = SDP;
+  static constexpr byte writeCycle = TWC;
+};
 
 //******************************************************************************************************************//
 //* Imposta il bus dati in INPUT o OUTPUT
@@ -32,17 +65,17 @@ byte readByte(unsigned int address) {
   digitalWrite(EEPROM_CE_PIN, HIGH);
   digitalWrite(EEPROM_OE_PIN, HIGH);
   digitalWrite(EEPROM_WE_PIN, HIGH);
-  delayMicroseconds(1);
+  busDelay(timing.hold);
 
   // Imposta indirizzo
   addressWrite(address);
   //Serial.println("address=" + (String)addr);
 
   digitalWrite(EEPROM_CE_PIN, LOW);
-  delayMicroseconds(1);
+  busDelay(timing.setup);
 
   digitalWrite(EEPROM_OE_PIN, LOW);
-  delayMicroseconds(1);
+  busDelay(timing.access);
   //delayMicroseconds(100);
 
   // Lettura pins D2/D9 (Bus Dati)
@@ -52,10 +85,10 @@ byte readByte(unsigned int address) {
   }
 
   digitalWrite(EEPROM_OE_PIN, HIGH);
-  delayMicroseconds(1);
+  busDelay(timing.hold);
 
   digitalWrite(EEPROM_CE_PIN, HIGH);
-  delayMicroseconds(1);
+  busDelay(timing.hold);
 
   return bval;
 }
@@ -80,27 +113,28 @@ byte writeByte(unsigned int address, byte value)
   {
     digitalWrite(dataPins[i], bitRead(value, i));
   }
-  delayMicroseconds(1);
+  busDelay(timing.setup);
 
   digitalWrite(EEPROM_CE_PIN, LOW);
-  delayMicroseconds(1);
+  busDelay(timing.setup);
 
   digitalWrite(EEPROM_WE_PIN, LOW);
-  delayMicroseconds(1);
+  busDelay(timing.pulse);
 
   digitalWrite(EEPROM_WE_PIN, HIGH);
-  delayMicroseconds(1);
+  busDelay(timing.hold);
 
   digitalWrite(EEPROM_CE_PIN, HIGH);
-  delayMicroseconds(1);
+  busDelay(timing.hold);
 
   return value;
 }
 
 //******************************************************************************************************************//
-//* Scrittura di una pagina di 64 byte all'indirizzo selezionato
+//* Scrittura di una pagina della memoria all'indirizzo selezionato
 //******************************************************************************************************************//
-byte writePage(unsigned int address, byte* page, unsigned int size)
+template <class Chip>
+byte writePage(unsigned int address, byte* page)
 {
   digitalWrite(EEPROM_CE_PIN, HIGH);
   digitalWrite(EEPROM_OE_PIN, HIGH);
@@ -110,7 +144,7 @@ byte writePage(unsigned int address, byte* page, unsigned int size)
   setDataBusMode(OUTPUT);
 
   byte value; // valore da scrivere, ultimo valore scritto
-  for (unsigned int idx = 0; idx < size; idx++) {
+  for (byte idx = 0; idx < Chip::pageSize; idx++) {
     value = writeByte(address + idx, page[idx]);
   }
 
@@ -118,28 +152,38 @@ byte writePage(unsigned int address, byte* page, unsigned int size)
 }
 
 //******************************************************************************************************************//
-//* Attende il termine della scrittura di un byte e ne verifica la corretta valorizzazione
+//* Attende per massimo timeout ms il termine della scrittura di un byte e ne verifica la corretta valorizzazione
 //******************************************************************************************************************//
-byte waitAndCheckWrite(byte value)
+byte waitWriteCycle(byte value, unsigned int timeout)
 {
   // Imposta il bus dati in input
   setDataBusMode(INPUT);
 
   digitalWrite(EEPROM_CE_PIN, LOW);
-  delayMicroseconds(1);
+  busDelay(timing.setup);
 
   digitalWrite(EEPROM_OE_PIN, LOW);
-  delayMicroseconds(1);
+  busDelay(timing.access);
 
   // Attende il termine della scrittura del byte, verificando
   // che il bit 7 corrisponda a quando scritto
   // durante la scrittura il bit 7 è il complemento di quanto inviato
-  while (bitRead(value, 7) != digitalRead(dataPins[7])) {
+  // (se la scrittura è stata ignorata, es. SDP attivo, esce dopo timeout ms)
+  unsigned long start = millis();
+  unsigned int wait = 0;
+  while (bitRead(value, 7) != digitalRead(dataPins[7]) && wait++ < timeout) {
     digitalWrite(EEPROM_OE_PIN, HIGH);
-    delayMicroseconds(1);
+    busDelay(timing.hold);
     delay(1);
     digitalWrite(EEPROM_OE_PIN, LOW);
-    delayMicroseconds(1);
+    busDelay(timing.access);
+  }
+
+  // Attesa effettiva in ms (il ciclo termina con wait oltre timeout solo allo scadere del timeout)
+  diag.writeCycles++;
+  diag.writeWait += millis() - start;
+  if (wait > timeout) {
+    diag.writeTimeouts++;
   }
 
   // Lettura pins D2/D9 (Bus Dati)
@@ -149,74 +193,865 @@ byte waitAndCheckWrite(byte value)
   }
 
   digitalWrite(EEPROM_OE_PIN, HIGH);
-  delayMicroseconds(1);
+  busDelay(timing.hold);
 
   digitalWrite(EEPROM_CE_PIN, HIGH);
-  delayMicroseconds(1);
+  busDelay(timing.hold);
 
   return bval;
 }
 
 //******************************************************************************************************************//
-//* Lettura della EEPROM
+//* Attende il termine della scrittura di un byte e ne verifica la corretta valorizzazione
+//******************************************************************************************************************//
+byte waitAndCheckWrite(byte value)
+{
+  return waitWriteCycle(value, WRITE_TIMEOUT);
+}
+
+//******************************************************************************************************************//
+//* Lettura di un byte da un trasferimento dati dell'host, ritorna -1 se non arriva entro STREAM_TIMEOUT ms
+//******************************************************************************************************************//
+int readStreamByte()
+{
+  unsigned long start = millis();
+  while (hostSerial.available() == 0) {
+    if (millis() - start >= STREAM_TIMEOUT) {
+      diag.streamTimeouts++;
+      return -1;
+    }
+  }
+
+  return hostSerial.read();
+}
+
+//******************************************************************************************************************//
+//* Verifica la richiesta di interruzione di un trasferimento verso l'host
+//******************************************************************************************************************//
+bool abortRequested()
+{
+  return hostSerial.available() > 0 && hostSerial.read() == ABORT_CHAR;
+}
+
+//******************************************************************************************************************//
+//* Lettura della EEPROM (limitata alla dimensione della memoria)
 //******************************************************************************************************************//
-void readEEPROM(unsigned int size) {
+template <class Chip>
+void readEngine(unsigned int size, bool rle) {
   unsigned int addr = 0;
+  if (size > Chip::size) {
+    size = Chip::size;
+  }
 
-  for (int i = 0; i < size; i++) {
+  rleBeginWrite();
+  for (unsigned int i = 0; i < size; i++) {
+    if (abortRequested()) {
+      return;
+    }
     byte bval = readByte(addr + i);
-    Serial.write(&bval, 1);
+    if (rle) {
+      rleWrite(bval);
+    } else {
+      hostSerial.write(&bval, 1);
+    }
+  }
+  if (rle) {
+    rleEndWrite();
   }
 }
 
 //******************************************************************************************************************//
-//* Scrittura della EEPROM
+//* Lettura della EEPROM con campionamento multiplo e voto di maggioranza
+//* Ogni indirizzo viene letto samples volte, ogni bit assume il valore della maggioranza dei campioni.
+//* Ogni gruppo di 8 indirizzi è inviato come: 8 valori, bitmap degli indirizzi instabili (bit 0 = primo indirizzo).
+//* Con un numero pari di campioni la maggioranza può non esistere: la richiesta viene ignorata
+//******************************************************************************************************************//
+void readVoteEEPROM(unsigned int size, byte samples) {
+  if (samples % 2 == 0) {
+    return;
+  }
+  // limitata alla dimensione della memoria, l'indirizzo del gruppo non supera mai la fine
+  if (size > chip->size) {
+    size = chip->size;
+  }
+
+  for (unsigned int addr = 0; addr < size; addr += 8) {
+    if (abortRequested()) {
+      return;
+    }
+
+    byte group[8];
+    byte unstable = 0;
+    for (byte i = 0; i < 8; i++) {
+      byte ones[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+      byte first = readByte(addr + i);
+      byte bval = first;
+      for (byte s = 0; s < samples; s++) {
+        if (s > 0) {
+          bval = readByte(addr + i);
+          if (bval != first) {
+            bitSet(unstable, i);
+          }
+        }
+        for (byte b = 0; b < 8; b++) {
+          ones[b] += bitRead(bval, b);
+        }
+      }
+
+      group[i] = 0;
+      for (byte b = 0; b < 8; b++) {
+        if (ones[b] * 2 > samples) {
+          bitSet(group[i], b);
+        }
+      }
+    }
+
+    hostSerial.write(group, 8);
+    hostSerial.write(&unstable, 1);
+  }
+}
+
+//******************************************************************************************************************//
+//* Lettura di un'area della EEPROM in blocchi verificati da CRC16
+//* Ogni blocco è inviato come: indirizzo (2 bytes), dati, CRC16 di indirizzo e dati (2 bytes), MSB first
+//******************************************************************************************************************//
+void readBlocksEEPROM(unsigned int start, unsigned int len, unsigned int blocksize) {
+  unsigned int end = start + len;
+
+  for (unsigned int addr = start; addr < end; addr += blocksize) {
+    if (abortRequested()) {
+      return;
+    }
+
+    unsigned int n = min(blocksize, end - addr);
+    unsigned int crc = 0xFFFF;
+    byte header[2] = { highByte(addr), lowByte(addr) };
+    crc = _crc_xmodem_update(crc, header[0]);
+    crc = _crc_xmodem_update(crc, header[1]);
+    hostSerial.write(header, 2);
+
+    for (unsigned int i = 0; i < n; i++) {
+      byte bval = readByte(addr + i);
+      crc = _crc_xmodem_update(crc, bval);
+      hostSerial.write(&bval, 1);
+    }
+
+    byte trailer[2] = { highByte(crc), lowByte(crc) };
+    hostSerial.write(trailer, 2);
+  }
+}
+
+//******************************************************************************************************************//
+//* Calcolo del CRC16 di un'area della EEPROM
+//******************************************************************************************************************//
+unsigned int checksumEEPROM(unsigned int start, unsigned int len) {
+  // CRC16 CCITT (polinomio 0x1021, valore iniziale 0xFFFF)
+  unsigned int crc = 0xFFFF;
+
+  for (unsigned int i = 0; i < len; i++) {
+    crc = _crc_xmodem_update(crc, readByte(start + i));
+  }
+
+  return crc;
+}
+
+//******************************************************************************************************************//
+//* Invia all'host i CRC16 dei blocchi di un'area della EEPROM su una riga di testo (+BLOCKSUMS=crc,crc,... in esadecimale)
+//* La riga viene inviata man mano che i blocchi sono calcolati, senza occupare memoria
 //******************************************************************************************************************//
-void writeEEPROM(unsigned int size)
+void blockSumsEEPROM(unsigned int start, unsigned int len, unsigned int blocksize) {
+  unsigned int end = start + len;
+
+  hostSerial.print("+BLOCKSUMS=");
+  for (unsigned int addr = start; addr < end; addr += blocksize) {
+    if (abortRequested()) {
+      break;
+    }
+    if (addr != start) {
+      hostSerial.print(",");
+    }
+    hostSerial.print(checksumEEPROM(addr, min(blocksize, end - addr)), HEX);
+  }
+  hostSerial.println();
+}
+
+//******************************************************************************************************************//
+//* Sequenza di sblocco Software Data Protection, precede il caricamento di un byte o di una pagina
+//* (se SDP era disabilitato la sequenza lo abilita)
+//******************************************************************************************************************//
+void unlockSDP()
+{
+  writeByte(0x5555, 0xaa);
+  writeByte(0x2aaa, 0x55);
+  writeByte(0x5555, 0xa0);
+}
+
+//******************************************************************************************************************//
+//* Scrittura della EEPROM (limitata alla dimensione della memoria, lo sblocco SDP è escluso per le memorie senza SDP)
+//******************************************************************************************************************//
+template <class Chip>
+void writeEngine(unsigned int size, bool sdp)
 {
   unsigned int address = 0;  
+  if (size > Chip::size) {
+    size = Chip::size;
+  }
 
   while (address < size)
   {
     // single byte write    
-    byte val = 0;
-    if (Serial.available() > 0) {
-      val = Serial.read();
-      writeByte(address, val);
-      byte wval = waitAndCheckWrite(val);
-      Serial.write(&wval, 1);
-      address++;
+    int val = readStreamByte();
+    if (val == -1) {
+      // trasferimento interrotto dall'host
+      return;
+    }
+    if (Chip::sdp && sdp) {
+      unlockSDP();
     }
+    writeByte(address, val);
+    byte wval = waitWriteCycle(val, Chip::writeCycle * 2);
+    hostSerial.write(&wval, 1);
+    address++;
   }
 }
 
 //******************************************************************************************************************//
-//* Scrittura della EEPROM in modo paginato
+//* Scrittura della EEPROM in modo paginato (pagine della dimensione della memoria)
 //******************************************************************************************************************//
-void writePagedEEPROM(unsigned int size, unsigned int pagesize)
+template <class Chip>
+void writePagedEngine(unsigned int size, bool sdp, bool rle)
 {
   unsigned int address = 0;  
+  if (size > Chip::size) {
+    size = Chip::size;
+  }
 
+  rleBeginRead();
   while (address < size)
   {
     // page write
-    unsigned int idx = 0;
-    #define PAGE_SIZE 64
-    byte page[PAGE_SIZE];
-    while (idx < PAGE_SIZE) {
-      if (Serial.available() > 0) {
-        page[idx++] = Serial.read();
+    byte idx = 0;
+    byte page[Chip::pageSize];
+    while (idx < Chip::pageSize) {
+      int val = rle ? rleRead() : readStreamByte();
+      if (val == -1) {
+        // trasferimento interrotto dall'host, la pagina incompleta non viene scritta
+        return;
       }
+      page[idx++] = val;
     }
-    byte val = writePage(address, page, PAGE_SIZE);
-    byte wval = waitAndCheckWrite(val);
+    if (Chip::sdp && sdp) {
+      unlockSDP();
+    }
+    byte val = writePage<Chip>(address, page);
+    byte wval = waitWriteCycle(val, Chip::writeCycle * 2);
     // feedback al programmatore dei bytes letti da EPROM
+    // (in modalità compressa ogni pagina è compressa separatamente)
     idx = 0;
-    while (idx < PAGE_SIZE) {
+    rleBeginWrite();
+    while (idx < Chip::pageSize) {
       byte val = readByte(address + idx++);
-      Serial.write(&val, 1);
+      if (rle) {
+        rleWrite(val);
+      } else {
+        hostSerial.write(&val, 1);
+      }
+    }
+    if (rle) {
+      rleEndWrite();
+    }
+    address += Chip::pageSize;
+  }
+}
+
+//******************************************************************************************************************//
+//* Valore dello schema FILL per l'indirizzo indicato (offset = distanza dall'indirizzo iniziale)
+//******************************************************************************************************************//
+byte fillValue(const FillPattern &pattern, unsigned int address, unsigned int offset)
+{
+  switch (pattern.mode) {
+    case FILL_ADDR:
+      return lowByte(address);
+    case FILL_ADDRX:
+      return lowByte(address) ^ highByte(address);
+    default:
+      return pattern.data[offset % pattern.len];
+  }
+}
+
+//******************************************************************************************************************//
+//* Programmazione di un'area con uno schema generato localmente, a pagine (o a byte per le memorie senza pagina).
+//* Le pagine che contengono già lo schema non vengono riscritte, ogni pagina scritta viene riletta e verificata
+//******************************************************************************************************************//
+template <class Chip>
+bool fillEngine(unsigned int start, unsigned int len, const FillPattern &pattern, bool sdp, unsigned int &errors)
+{
+  errors = 0;
+  if (start >= Chip::size) {
+    return true;
+  }
+  if (len > Chip::size - start) {
+    len = Chip::size - start;
+  }
+  unsigned int end = start + len;
+
+  unsigned int address = start;
+  while (address < end) {
+    if (abortRequested()) {
+      return false;
+    }
+
+    // la scrittura non può superare il limite della pagina
+    unsigned int next = (address / Chip::pageSize + 1) * Chip::pageSize;
+    if (next > end) {
+      next = end;
+    }
+    byte count = next - address;
+
+    byte page[Chip::pageSize];
+    bool changed = false;
+    for (byte idx = 0; idx < count; idx++) {
+      page[idx] = fillValue(pattern, address + idx, address + idx - start);
+      if (readByte(address + idx) != page[idx]) {
+        changed = true;
+      }
+    }
+
+    if (changed) {
+      if (Chip::sdp && sdp) {
+        unlockSDP();
+      }
+      byte val;
+      for (byte idx = 0; idx < count; idx++) {
+        val = writeByte(address + idx, page[idx]);
+      }
+      waitWriteCycle(val, Chip::writeCycle * 2);
+
+      for (byte idx = 0; idx < count; idx++) {
+        if (readByte(address + idx) != page[idx]) {
+          errors++;
+        }
+      }
+    }
+
+    address = next;
+  }
+
+  return true;
+}
+
+//******************************************************************************************************************//
+//* Attende il termine di un ciclo di scrittura con polling continuo di DATA7 (timeout in ms),
+//* ritorna la durata in us misurata dall'ultimo byte caricato, SCAN_TIMEOUT se non termina
+//******************************************************************************************************************//
+unsigned int timeWriteCycle(byte value, unsigned int timeout)
+{
+  unsigned long start = micros();
+  unsigned long elapsed = 0;
+
+  setDataBusMode(INPUT);
+  digitalWrite(EEPROM_CE_PIN, LOW);
+  busDelay(timing.setup);
+
+  // Ogni lettura è un nuovo ciclo di OE, durante la scrittura DATA7 è il complemento del valore scritto
+  bool done = false;
+  while (!done && elapsed < timeout * 1000UL) {
+    digitalWrite(EEPROM_OE_PIN, LOW);
+    busDelay(timing.access);
+    done = bitRead(value, 7) == digitalRead(dataPins[7]);
+    digitalWrite(EEPROM_OE_PIN, HIGH);
+    busDelay(timing.hold);
+    elapsed = micros() - start;
+  }
+
+  digitalWrite(EEPROM_CE_PIN, HIGH);
+  busDelay(timing.hold);
+
+  diag.writeCycles++;
+  diag.writeWait += elapsed / 1000;
+  if (!done) {
+    diag.writeTimeouts++;
+    return SCAN_TIMEOUT;
+  }
+  return min(elapsed, (unsigned long)SCAN_TIMEOUT - 1);
+}
+
+//******************************************************************************************************************//
+//* Scrive un blocco misurato (una pagina, o SCAN_BLOCK bytes a singolo byte), ritorna la durata massima in us
+//******************************************************************************************************************//
+template <class Chip>
+unsigned int scanWrite(unsigned int address, const byte* data, byte count, bool sdp)
+{
+  unsigned int slowest = 0;
+  if (Chip::pageSize > 1) {
+    if (Chip::sdp && sdp) {
+      unlockSDP();
+    }
+    byte val;
+    for (byte idx = 0; idx < count; idx++) {
+      val = writeByte(address + idx, data[idx]);
+    }
+    slowest = timeWriteCycle(val, Chip::writeCycle * 2);
+  } else {
+    for (byte idx = 0; idx < count; idx++) {
+      if (Chip::sdp && sdp) {
+        unlockSDP();
+      }
+      byte val = writeByte(address + idx, data[idx]);
+      unsigned int cycle = timeWriteCycle(val, Chip::writeCycle * 2);
+      if (cycle > slowest) {
+        slowest = cycle;
+      }
+    }
+  }
+  return slowest;
+}
+
+//******************************************************************************************************************//
+//* Misura dei cicli di scrittura dell'intera memoria: per ogni blocco l'host invia il contenuto originale,
+//* il blocco viene scritto con il complemento (ogni bit cambia stato), verificato, riscritto con l'originale e
+//* verificato. Per ogni blocco invia all'host 5 bytes: durata scrittura di prova e di ripristino (us, MSB first)
+//* e numero di bytes non verificati (massimo 255). Un blocco viene modificato solo dopo averlo ricevuto per
+//* intero e il ripristino non dipende dall'host: un'interruzione lascia invariati tutti i blocchi
+//******************************************************************************************************************//
+template <class Chip>
+void scanEngine(unsigned int size, bool sdp)
+{
+  const byte unit = Chip::pageSize > 1 ? Chip::pageSize : SCAN_BLOCK;
+  unsigned int address = 0;
+  if (size > Chip::size) {
+    size = Chip::size;
+  }
+
+  while (address < size) {
+    byte data[unit];
+    for (byte idx = 0; idx < unit; idx++) {
+      int val = readStreamByte();
+      if (val == -1) {
+        // trasferimento interrotto dall'host, il blocco non è ancora stato modificato
+        return;
+      }
+      data[idx] = val;
+    }
+
+    // da qui fino al ripristino nessuna attesa dell'host
+    unsigned int errors = 0;
+    for (byte idx = 0; idx < unit; idx++) {
+      data[idx] = ~data[idx];
+    }
+    unsigned int test = scanWrite<Chip>(address, data, unit, sdp);
+    for (byte idx = 0; idx < unit; idx++) {
+      errors += readByte(address + idx) != data[idx];
+      data[idx] = ~data[idx];
+    }
+    unsigned int restore = scanWrite<Chip>(address, data, unit, sdp);
+    for (byte idx = 0; idx < unit; idx++) {
+      errors += readByte(address + idx) != data[idx];
+    }
+
+    byte result[5] = { highByte(test), lowByte(test), highByte(restore), lowByte(restore), (byte)min(errors, 255U) };
+    hostSerial.write(result, 5);
+    address += unit;
+  }
+}
+
+//******************************************************************************************************************//
+//* Motori istanziati per ogni memoria della tabella Chips.h
+//******************************************************************************************************************//
+#define CHIP_ID(NAME, SIZE, PAGE, SDP, TWC) CHIP_##NAME,
+#define CHIP_ENGINE(NAME, SIZE, PAGE, SDP, TWC) { \
+    #NAME, SIZE, PAGE, SDP, TWC, \
+    readEngine<ChipDescriptor<SIZE, PAGE, SDP, TWC> >, \
+    writeEngine<ChipDescriptor<SIZE, PAGE, SDP, TWC> >, \
+    writePagedEngine<ChipDescriptor<SIZE, PAGE, SDP, TWC> >, \
+    fillEngine<ChipDescriptor<SIZE, PAGE, SDP, TWC> >, \
+    scanEngine<ChipDescriptor<SIZE, PAGE, SDP, TWC> > },
+
+enum ChipId { AT28C_CHIPS(CHIP_ID) CHIP_COUNT };
+
+const ChipEngine chips[CHIP_COUNT] = { AT28C_CHIPS(CHIP_ENGINE) };
+
+const ChipEngine* chip = &chips[CHIP_AT28C256];
+
+bool selectChip(const char* name)
+{
+  for (byte i = 0; i < CHIP_COUNT; i++) {
+    if (strcmp(chips[i].name, name) == 0) {
+      chip = &chips[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+//******************************************************************************************************************//
+//* Lettura della EEPROM
+//******************************************************************************************************************//
+void readEEPROM(unsigned int size, bool rle) {
+  chip->read(size, rle);
+}
+
+//******************************************************************************************************************//
+//* Scrittura della EEPROM
+//******************************************************************************************************************//
+void writeEEPROM(unsigned int size, bool sdp)
+{
+  chip->write(size, sdp);
+}
+
+//******************************************************************************************************************//
+//* Scrittura della EEPROM in modo paginato
+//******************************************************************************************************************//
+void writePagedEEPROM(unsigned int size, bool sdp, bool rle)
+{
+  chip->writePaged(size, sdp, rle);
+}
+
+//******************************************************************************************************************//
+//* Programmazione di un'area della EEPROM con uno schema generato dal firmware
+//******************************************************************************************************************//
+bool fillEEPROM(unsigned int start, unsigned int len, const FillPattern &pattern, bool sdp, unsigned int &errors)
+{
+  return chip->fill(start, len, pattern, sdp, errors);
+}
+
+//******************************************************************************************************************//
+//* Misura dei cicli di scrittura dell'intera memoria
+//******************************************************************************************************************//
+void scanEEPROM(unsigned int size, bool sdp)
+{
+  chip->scan(size, sdp);
+}
+
+//******************************************************************************************************************//
+//* Scrittura di prova di un byte, attende il tempo massimo di scrittura (tWC 10 ms)
+//* e ritorna il valore riletto
+//******************************************************************************************************************//
+byte probeWrite(unsigned int address, byte value, bool sdp)
+{
+  if (sdp) {
+    unlockSDP();
+  }
+  writeByte(address, value);
+  delay(10);
+
+  return readByte(address);
+}
+
+//******************************************************************************************************************//
+//* Riconoscimento della dimensione della EEPROM e dello stato del Software Data Protection
+//******************************************************************************************************************//
+void probeEEPROM(unsigned int &size, bool &sdp)
+{
+  // Una AT28C16 non decodifica A11..A14: le locazioni a distanza 0x0800 e 0x1000 sono speculari
+  bool mirrored2k = true;
+  for (unsigned int addr = 0; addr < 0x0800 && mirrored2k; addr += 0x80) {
+    byte val = readByte(addr);
+    if (readByte(addr | 0x0800) != val || readByte(addr | 0x1000) != val) {
+      mirrored2k = false;
+    }
+  }
+
+  // Una AT28C64 non decodifica A13/A14: le locazioni a distanza 0x2000 e 0x4000 sono speculari.
+  // Se anche una sola coppia differisce la memoria decodifica tutto lo spazio di 32 KB
+  bool mirrored = true;
+  for (unsigned int addr = 0; addr < 0x2000 && mirrored; addr += 0x200) {
+    byte val = readByte(addr);
+    if (readByte(addr | 0x2000) != val || readByte(addr | 0x4000) != val) {
+      mirrored = false;
+    }
+  }
+
+  // Scrittura di prova del complemento a 0x2000: se il byte non cambia SDP è attivo
+  byte orig = readByte(0x2000);
+  byte test = orig ^ 0xFF;
+  sdp = probeWrite(0x2000, test, false) == orig;
+
+  if (mirrored) {
+    // Contenuto speculare (es. memoria vuota): con SDP attivo ripete la scrittura con la sequenza di sblocco,
+    // poi verifica se la scrittura a 0x2000 si riflette a 0x0000
+    if (sdp) {
+      probeWrite(0x2000, test, true);
+    }
+    mirrored = readByte(0x0000) == test;
+    // Con il contenuto speculare anche a 0x0800 il byte originale vale orig: se ora vale test
+    // la scrittura a 0x2000 si riflette anche a 0x0800 e la memoria decodifica solo 2 KB
+    mirrored2k = mirrored2k && mirrored && readByte(0x0800) == test;
+  }
+  size = mirrored2k ? 2048 : (mirrored ? 8192 : 32768);
+
+  // Ripristina il contenuto originale
+  if (readByte(0x2000) != orig) {
+    probeWrite(0x2000, orig, sdp);
+  }
+}
+
+//******************************************************************************************************************//
+//* Profilo di temporizzazione salvato nella EEPROM interna
+//******************************************************************************************************************//
+#define TIMING_MAGIC 0xA5
+
+struct StoredTiming {
+  byte magic;
+  TimingProfile profile;
+};
+
+void loadTiming()
+{
+  StoredTiming stored;
+  EEPROM.get(TIMING_EEPROM_ADDRESS, stored);
+  // EEPROM interna vergine o profilo non valido: mantiene il profilo predefinito
+  if (stored.magic == TIMING_MAGIC &&
+      stored.profile.setup <= TIMING_MAX && stored.profile.access <= TIMING_MAX &&
+      stored.profile.pulse <= TIMING_MAX && stored.profile.hold <= TIMING_MAX) {
+    timing = stored.profile;
+  }
+}
+
+void saveTiming()
+{
+  StoredTiming stored = { TIMING_MAGIC, timing };
+  EEPROM.put(TIMING_EEPROM_ADDRESS, stored);
+}
+
+//******************************************************************************************************************//
+//* Schema di prova di TUNE: valori e complementi alternati ad ogni passaggio, ogni bit del bus dati cambia
+//******************************************************************************************************************//
+const byte tunePattern[TUNE_BYTES] = {
+  0x00, 0xFF, 0x55, 0xAA, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0xFE, 0xFD, 0xFB, 0xF7
+};
+
+byte tuneValue(byte idx, bool complement)
+{
+  return complement ? ~tunePattern[idx] : tunePattern[idx];
+}
+
+// Scrive lo schema di prova con il profilo in uso (a singolo byte, supportato da tutte le memorie)
+void tuneWrite(unsigned int address, bool complement, bool sdp)
+{
+  for (byte idx = 0; idx < TUNE_BYTES; idx++) {
+    if (sdp) {
+      unlockSDP();
+    }
+    byte value = writeByte(address + idx, tuneValue(idx, complement));
+    waitAndCheckWrite(value);
+  }
+}
+
+// Rilegge ripetutamente lo schema di prova con il profilo in uso
+bool tuneRead(unsigned int address, bool complement)
+{
+  for (byte r = 0; r < TUNE_READS; r++) {
+    for (byte idx = 0; idx < TUNE_BYTES; idx++) {
+      if (readByte(address + idx) != tuneValue(idx, complement)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Ripristina il contenuto originale dell'area di prova, con lo sblocco SDP usato dall'ultima scrittura
+void tuneRestore(unsigned int address, const byte* original, bool sdp)
+{
+  for (byte idx = 0; idx < TUNE_BYTES; idx++) {
+    if (readByte(address + idx) != original[idx]) {
+      if (sdp) {
+        unlockSDP();
+      }
+      byte value = writeByte(address + idx, original[idx]);
+      waitAndCheckWrite(value);
+    }
+  }
+}
+
+bool tuneTiming(unsigned int address)
+{
+  // Area di prova interamente nella memoria selezionata (oltre la fine le scritture ricadrebbero all'inizio)
+  if ((unsigned long)address + TUNE_BYTES > chip->size) {
+    return false;
+  }
+
+  TimingProfile safe = { TIMING_MAX, TIMING_MAX, TIMING_MAX, TIMING_MAX };
+  TimingProfile previous = timing;
+  timing = safe;
+
+  // Salva il contenuto dell'area di prova
+  byte original[TUNE_BYTES];
+  for (byte idx = 0; idx < TUNE_BYTES; idx++) {
+    original[idx] = readByte(address + idx);
+  }
+
+  // Verifica lo schema con il profilo sicuro, se la scrittura viene ignorata ripete con lo sblocco SDP
+  bool complement = false;
+  bool sdp = false;
+  tuneWrite(address, complement, sdp);
+  if (!tuneRead(address, complement)) {
+    sdp = true;
+    tuneWrite(address, complement, sdp);
+    if (!tuneRead(address, complement)) {
+      // anche una scrittura parziale dello schema viene annullata
+      tuneRestore(address, original, sdp);
+      timing = previous;
+      return false;
+    }
+  }
+
+  // Riduce un parametro alla volta fino al primo errore, poi mantiene due passi di margine
+  TimingProfile best = safe;
+  byte* params[4] = { &best.setup, &best.access, &best.pulse, &best.hold };
+  for (byte p = 0; p < 4; p++) {
+    byte failed = 0xFF;
+    for (int value = TIMING_MAX - 1; value >= 0; value--) {
+      *params[p] = value;
+      timing = best;
+      complement = !complement;
+      tuneWrite(address, complement, sdp);
+      if (!tuneRead(address, complement)) {
+        failed = value;
+        break;
+      }
+    }
+    *params[p] = failed == 0xFF ? 0 : min(failed + 2, TIMING_MAX);
+  }
+
+  // Ripristina il contenuto dell'area di prova con il profilo sicuro
+  timing = safe;
+  tuneRestore(address, original, sdp);
+
+  timing = best;
+  saveTiming();
+  return true;
+}
+
+//******************************************************************************************************************//
+//* Valori di prova di SELFTEST: un solo bit a 1 o un solo bit a 0, tutti diversi tra loro
+//******************************************************************************************************************//
+const byte selfTestValues[SELFTEST_VALUES] = {
+  0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0xFE, 0xFD, 0xFB, 0xF7, 0xEF, 0xDF, 0xBF, 0x7F
+};
+
+// Scrive una serie di prova (a singolo byte, supportato da tutte le memorie)
+void selfTestWrite(const unsigned int* addrs, const byte* values, byte count, bool sdp)
+{
+  for (byte n = 0; n < count; n++) {
+    if (sdp) {
+      unlockSDP();
+    }
+    byte value = writeByte(addrs[n], values[n]);
+    waitAndCheckWrite(value);
+  }
+}
+
+void selfTestEEPROM(unsigned int address, SelfTestResult &result)
+{
+  // Linee di indirizzo decodificate dalla memoria selezionata
+  byte lines = 0;
+  while ((1UL << lines) < chip->size) {
+    lines++;
+  }
+  byte count = lines + 1;
+
+  result.addressStuck = 0;
+  result.addressShort = 0;
+  result.dataStuck = 0;
+  result.dataShort = 0;
+
+  // Verifiche ed errori di ogni linea dati con valore atteso 1 e 0
+  byte tested1[8] = { 0 }, failed1[8] = { 0 }, tested0[8] = { 0 }, failed0[8] = { 0 };
+  // Linee di indirizzo che selezionano la cella della base in ciascuna serie
+  unsigned int baseAlias[2] = { 0, 0 };
+  bool sdp = false;
+
+  // Serie con base all'indirizzo indicato e al suo complemento: ogni linea di indirizzo passa da 0 a 1 e da 1 a 0
+  for (byte set = 0; set < 2; set++) {
+    unsigned int base = (set == 0 ? address : ~address) & (chip->size - 1);
+    unsigned int addrs[SELFTEST_VALUES];
+    byte values[SELFTEST_VALUES];
+    byte original[SELFTEST_VALUES];
+    for (byte n = 0; n < count; n++) {
+      addrs[n] = n == 0 ? base : base ^ (1 << (n - 1));
+      // Valori sfalsati tra le due serie: anche con meno linee di indirizzo tutti i valori vengono provati
+      values[n] = selfTestValues[(n + set * (SELFTEST_VALUES - count)) % SELFTEST_VALUES];
+      original[n] = readByte(addrs[n]);
+    }
+
+    // Se la scrittura viene ignorata (SDP attivo) la ripete con la sequenza di sblocco
+    selfTestWrite(addrs, values, count, sdp);
+    if (!sdp && chip->sdp) {
+      bool ignored = true;
+      for (byte n = 0; n < count && ignored; n++) {
+        ignored = readByte(addrs[n]) == original[n];
+      }
+      if (ignored) {
+        sdp = true;
+        selfTestWrite(addrs, values, count, sdp);
+      }
+    }
+
+    // Base sovrascritta da una locazione successiva: tutte le locazioni che rileggono lo stesso valore
+    // selezionano la cella della base (una per ogni linea di indirizzo che non cambia stato)
+    byte baseValue = readByte(addrs[0]);
+    bool baseOverwritten = false;
+    for (byte m = 1; m < count; m++) {
+      baseOverwritten |= baseValue != values[0] && baseValue == values[m];
+    }
+
+    for (byte n = 0; n < count; n++) {
+      byte value = readByte(addrs[n]);
+      if (baseOverwritten && value == baseValue) {
+        if (n != 0) {
+          baseAlias[set] |= 1 << (n - 1);
+        }
+        continue;
+      }
+      if (value != values[n]) {
+        // Valore di una locazione scritta dopo: i due indirizzi selezionano la stessa cella
+        byte alias = 0;
+        for (byte m = n + 1; m < count; m++) {
+          if (value == values[m]) {
+            alias = m;
+          }
+        }
+        if (alias != 0) {
+          result.addressShort |= (1 << (n - 1)) | (1 << (alias - 1));
+          continue;
+        }
+      }
+      for (byte b = 0; b < 8; b++) {
+        if (bitRead(values[n], b)) {
+          tested1[b]++;
+          failed1[b] += !bitRead(value, b);
+        } else {
+          tested0[b]++;
+          failed0[b] += bitRead(value, b);
+        }
+      }
+    }
+
+    // Ripristina il contenuto originale
+    for (byte n = 0; n < count; n++) {
+      if (readByte(addrs[n]) != original[n]) {
+        if (sdp) {
+          unlockSDP();
+        }
+        byte value = writeByte(addrs[n], original[n]);
+        waitAndCheckWrite(value);
+      }
+    }
+  }
+
+  // Linea di indirizzo bloccata: non cambia stato in nessuna delle due serie, se solo in una segue un'altra linea (corto)
+  result.addressStuck = baseAlias[0] & baseAlias[1];
+  result.addressShort |= baseAlias[0] ^ baseAlias[1];
+
+  // Linea dati bloccata: errata in tutte le verifiche con il valore opposto, altrimenti in corto con un'altra linea
+  for (byte b = 0; b < 8; b++) {
+    if ((tested1[b] > 0 && failed1[b] == tested1[b]) || (tested0[b] > 0 && failed0[b] == tested0[b])) {
+      bitSet(result.dataStuck, b);
+    } else if (failed1[b] > 0 || failed0[b] > 0) {
+      bitSet(result.dataShort, b);
     }
-    address += PAGE_SIZE;
   }
 }
 
@@ -238,7 +1073,5 @@ void disableSDP()
 //******************************************************************************************************************//
 void enableSDP()
 {
-  writeByte(0x5555, 0xaa);
-  writeByte(0x2aaa, 0x55);
-  writeByte(0x5555, 0xa0);
+  unlockSDP();
 }
@@ -7,6 +7,65 @@
 
 #include <Arduino.h>
 
+//******************************************************************************************************************//
+//* Profilo di temporizzazione del bus (attese in us, 0 = nessuna attesa)
+//******************************************************************************************************************//
+struct TimingProfile {
+  // setup di indirizzo e dati prima dei segnali di controllo
+  byte setup;
+  // tempo di accesso in lettura dopo OE
+  byte access;
+  // durata dell'impulso WE
+  byte pulse;
+  // mantenimento dopo il rilascio dei segnali di controllo
+  byte hold;
+};
+
+// Profilo in uso
+extern TimingProfile timing;
+
+//******************************************************************************************************************//
+//* Schema di programmazione generato dal firmware
+//******************************************************************************************************************//
+enum FillMode {
+  // sequenza di bytes ripetuta a partire dall'indirizzo iniziale
+  FILL_BYTES,
+  // byte basso dell'indirizzo
+  FILL_ADDR,
+  // byte basso dell'indirizzo XOR byte alto (distingue le pagine)
+  FILL_ADDRX
+};
+
+struct FillPattern {
+  FillMode mode;
+  byte len;
+  byte data[FILL_MAX_PATTERN];
+};
+
+//******************************************************************************************************************//
+//* Memoria selezionata: parametri della tabella Chips.h e motori di lettura/scrittura specializzati per la memoria
+//******************************************************************************************************************//
+struct ChipEngine {
+  const char* name;
+  unsigned int size;
+  byte pageSize;
+  bool sdp;
+  byte writeCycle;
+  void (*read)(unsigned int size, bool rle);
+  void (*write)(unsigned int size, bool sdp);
+  void (*writePaged)(unsigned int size, bool sdp, bool rle);
+  bool (*fill)(unsigned int start, unsigned int len, const FillPattern &pattern, bool sdp, unsigned int &errors);
+  void (*scan)(unsigned int size, bool sdp);
+};
+
+// Memoria in uso (predefinita AT28C256)
+extern const ChipEngine* chip;
+
+//******************************************************************************************************************//
+//* Seleziona la memoria in uso per nome, ritorna false se la memoria non è presente nella tabella
+//******************************************************************************************************************//
+bool selectChip(const char* name);
+
 //******************************************************************************************************************//
 //* Lettura di un byte all'indirizzo selezionato
 //******************************************************************************************************************//
@@ -22,20 +81,96 @@ byte writeByte(unsigned int address, byte value);
 //******************************************************************************************************************//
 byte waitAndCheckWrite(byte value);
 
+//******************************************************************************************************************//
+//* Lettura di un byte da un trasferimento dati dell'host, ritorna -1 se non arriva entro STREAM_TIMEOUT ms
+//******************************************************************************************************************//
+int readStreamByte();
+
 //******************************************************************************************************************//
 //* Scrittura della EEPROM
 //******************************************************************************************************************//
-void writeEEPROM(unsigned int size);
+void writeEEPROM(unsigned int size, bool sdp);
 
 //******************************************************************************************************************//
-//* Scrittura della EEPROM in modo paginato
+//* Scrittura della EEPROM in modo paginato (pagine della dimensione della memoria selezionata)
 //******************************************************************************************************************//
-void writePagedEEPROM(unsigned int size, unsigned int pagesize);
+void writePagedEEPROM(unsigned int size, bool sdp, bool rle);
+
+//******************************************************************************************************************//
+//* Programmazione di un'area della EEPROM con uno schema generato dal firmware,
+//* errors riceve il numero di bytes non verificati, ritorna false se interrotta dall'host
+//******************************************************************************************************************//
+bool fillEEPROM(unsigned int start, unsigned int len, const FillPattern &pattern, bool sdp, unsigned int &errors);
+
+//******************************************************************************************************************//
+//* Misura dei cicli di scrittura dell'intera memoria a blocchi (pagine o SCAN_BLOCK bytes): per ogni blocco l'host
+//* invia il contenuto originale, riceve la durata della scrittura di prova e del ripristino e i bytes non verificati
+//******************************************************************************************************************//
+void scanEEPROM(unsigned int size, bool sdp);
 
 //******************************************************************************************************************//
 //* Lettura della EEPROM
 //******************************************************************************************************************//
-void readEEPROM(unsigned int size);
+void readEEPROM(unsigned int size, bool rle);
+
+//******************************************************************************************************************//
+//* Lettura della EEPROM con campionamento multiplo e voto di maggioranza (numero di campioni dispari,
+//* limitata alla dimensione della memoria)
+//******************************************************************************************************************//
+void readVoteEEPROM(unsigned int size, byte samples);
+
+//******************************************************************************************************************//
+//* Lettura di un'area della EEPROM in blocchi verificati da CRC16
+//******************************************************************************************************************//
+void readBlocksEEPROM(unsigned int start, unsigned int len, unsigned int blocksize);
+
+//******************************************************************************************************************//
+//* Calcolo del CRC16 di un'area della EEPROM
+//******************************************************************************************************************//
+unsigned int checksumEEPROM(unsigned int start, unsigned int len);
+
+//******************************************************************************************************************//
+//* Invia all'host i CRC16 dei blocchi di un'area della EEPROM su una riga di testo (+BLOCKSUMS=crc,crc,... in esadecimale)
+//******************************************************************************************************************//
+void blockSumsEEPROM(unsigned int start, unsigned int len, unsigned int blocksize);
+
+//******************************************************************************************************************//
+//* Riconoscimento della dimensione della EEPROM e dello stato del Software Data Protection
+//******************************************************************************************************************//
+void probeEEPROM(unsigned int &size, bool &sdp);
+
+//******************************************************************************************************************//
+//* Carica il profilo di temporizzazione salvato nella EEPROM interna (all'avvio)
+//******************************************************************************************************************//
+void loadTiming();
+
+//******************************************************************************************************************//
+//* Salva il profilo di temporizzazione in uso nella EEPROM interna
+//******************************************************************************************************************//
+void saveTiming();
+
+//******************************************************************************************************************//
+//* Ricerca del profilo di temporizzazione più veloce con margine di sicurezza,
+//* utilizza TUNE_BYTES bytes all'indirizzo indicato come area di prova e ne ripristina il contenuto,
+//* ritorna false se l'area non è interamente nella memoria selezionata
+//******************************************************************************************************************//
+bool tuneTiming(unsigned int address);
+
+//******************************************************************************************************************//
+//* Esito della verifica del bus: maschere delle linee bloccate e in corto (bit 0 = A0 / D0)
+//******************************************************************************************************************//
+struct SelfTestResult {
+  unsigned int addressStuck;
+  unsigned int addressShort;
+  byte dataStuck;
+  byte dataShort;
+};
+
+//******************************************************************************************************************//
+//* Verifica walking-ones/zeros delle linee di indirizzo e dati, utilizza le locazioni all'indirizzo indicato,
+//* al suo complemento e a distanza di una linea di indirizzo da entrambi, poi ne ripristina il contenuto
+//******************************************************************************************************************//
+void selfTestEEPROM(unsigned int address, SelfTestResult &result);
 
 //******************************************************************************************************************//
 //* Disabilita Software Data Protection
@@ -7,6 +7,7 @@
 #include <Arduino.h>
 #include "Const.h"
 #include "SRHelper.h"
+#include "DiagHelper.h"
 #include "AT28C.h"
 
 //******************************************************************************************************************//
@@ -15,6 +16,9 @@
 bool serialEcho = false;
 
 void setup() {
+  // Riempie la SRAM libera per la misura della memoria minima (DIAG)
+  diagBegin();
+
   // Inizializza Ouput Pins per SN74HC595
   pinMode(SN_SRCLK_PIN, OUTPUT);
   pinMode(SN_SER_PIN, OUTPUT);
@@ -38,18 +42,28 @@ void setup() {
   // Azzera lo shift register
   //addressWrite(0x0000);
 
-  Serial.begin(115200);
+  // Profilo di temporizzazione del bus salvato da TUNE
+  loadTiming();
+
+  hostSerial.begin(115200);
   // Versione prodotto (come PCB)
-  Serial.println("AT28C EEPROM PROGRAMMER V.1.1");
-  Serial.println("");
+  hostSerial.println("AT28C EEPROM PROGRAMMER V.1.1");
+  hostSerial.println("");
 }
 
 void loop() {
+  unsigned long start = micros();
+
   // Lettura porta seriale
   String s = ReadSerialComand();
 
   // Parsing dei comandi
   ParseComands(s);
+
+  // Durata dei cicli senza comandi: ritardo massimo nella presa in carico di un comando (DIAG)
+  if (s == "") {
+    diagLoop(micros() - start);
+  }
 }
 
 //******************************************************************************************************************//
@@ -58,11 +72,12 @@ void loop() {
 // Parsing dei comandi
 void ParseComands(String s) {
   String params[10];
+  unsigned long start = micros();
 
   s.toUpperCase();
   if (s != "") {
     if (serialEcho) {
-      Serial.println(s);
+      hostSerial.println(s);
     }
 
     String comand = GetComand(s);
@@ -80,8 +95,19 @@ void ParseComands(String s) {
         serialEcho = false;
       }
       else if (params[0] == "?") {
-        Serial.println("+ECHO=" + String(serialEcho));
+        hostSerial.println("+ECHO=" + String(serialEcho));
+      }
+    }
+    //**********************************************
+    // SYNC
+    //**********************************************
+    if (comand == "SYNC") {
+      GetComandParams(s, params);
+      // Scarta i dati residui di un trasferimento interrotto e conferma con lo stesso parametro ricevuto
+      while (hostSerial.available() > 0) {
+        hostSerial.read();
       }
+      hostSerial.println("+SYNC=" + params[0]);
     }
     //**********************************************
     // VERSION
@@ -91,7 +117,47 @@ void ParseComands(String s) {
       // Serial.println("PARAM: " + params[0]);
       if (params[0] == "?") {
         // Versione del firmware incrementale
-        Serial.println("+VERSION=0.003");
+        hostSerial.println("+VERSION=0.008");
+      }
+    }
+    //**********************************************
+    // RLE
+    //**********************************************
+    if (comand == "RLE") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0]);
+      if (params[0] == "?") {
+        // Trasferimenti compressi RLE supportati
+        hostSerial.println("+RLE=1");
+      }
+    }
+    //**********************************************
+    // RXBUFFER
+    //**********************************************
+    if (comand == "RXBUFFER") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0]);
+      if (params[0] == "?") {
+        // Dimensione del buffer di ricezione seriale, limita i bytes in transito nella scrittura a singolo byte
+        hostSerial.println("+RXBUFFER=" + String(SERIAL_RX_BUFFER_SIZE));
+      }
+    }
+    //**********************************************
+    // CHIP
+    //**********************************************
+    if (comand == "CHIP") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0]);
+      if (params[0] == "?") {
+        hostSerial.println("+CHIP=" + GetChip());
+      }
+      else if (params[0] != "") {
+        // Seleziona i motori di lettura e scrittura della memoria indicata
+        if (selectChip(params[0].c_str())) {
+          hostSerial.println("+CHIP=" + GetChip());
+        } else {
+          hostSerial.println("+CHIP=-1");
+        }
       }
     }
     //**********************************************
@@ -102,7 +168,7 @@ void ParseComands(String s) {
       //Serial.println("PARAM: " + params[0]);
       if (params[0] != "") {
         byte b = readByte(params[0].toInt());
-        Serial.println("+READBYTE=" + (String)b);
+        hostSerial.println("+READBYTE=" + (String)b);
       }
     }
     //**********************************************
@@ -114,7 +180,7 @@ void ParseComands(String s) {
       if (params[0] != "") {
         byte b = writeByte(params[0].toInt(), params[1].toInt());
         byte wb = waitAndCheckWrite(b);
-        Serial.println("+WRITEBYTE=" + (String)wb);
+        hostSerial.println("+WRITEBYTE=" + (String)wb);
       }
     }
     //**********************************************
@@ -124,26 +190,149 @@ void ParseComands(String s) {
       GetComandParams(s, params);
       // Serial.println("PARAM: " + params[0]);
       if (params[0] != "") {
-        readEEPROM(params[0].toInt());
+        // secondo parametro a 1: trasferimento compresso RLE
+        readEEPROM(params[0].toInt(), params[1] == "1");
         //Serial.println("+++");
       }
     }
     //**********************************************
+    // READVOTE
+    //**********************************************
+    if (comand == "READVOTE") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0] + "," + params[1]);
+      // numero di campioni dispari da 1 a VOTE_MAX_SAMPLES, altrimenti la richiesta viene ignorata
+      int samples = params[1].toInt();
+      if (params[0] != "" && samples >= 1 && samples <= VOTE_MAX_SAMPLES && samples % 2 == 1) {
+        readVoteEEPROM(params[0].toInt(), samples);
+      }
+    }
+    //**********************************************
+    // READBLOCKS
+    //**********************************************
+    if (comand == "READBLOCKS") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0] + "," + params[1] + "," + params[2]);
+      if (params[0] != "" && params[1] != "" && params[2].toInt() > 0) {
+        readBlocksEEPROM(params[0].toInt(), params[1].toInt(), params[2].toInt());
+      }
+    }
+    //**********************************************
+    // CHECKSUM
+    //**********************************************
+    if (comand == "CHECKSUM") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0] + "," + params[1]);
+      if (params[0] != "" && params[1] != "") {
+        unsigned int crc = checksumEEPROM(params[0].toInt(), params[1].toInt());
+        hostSerial.println("+CHECKSUM=" + (String)crc);
+      }
+    }
+    //**********************************************
+    // BLOCKSUMS
+    //**********************************************
+    if (comand == "BLOCKSUMS") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0] + "," + params[1] + "," + params[2]);
+      if (params[0] != "" && params[1] != "" && params[2].toInt() > 0) {
+        blockSumsEEPROM(params[0].toInt(), params[1].toInt(), params[2].toInt());
+      }
+    }
+    //**********************************************
     // WRITEEEPROM
     //**********************************************
     if (comand == "WRITEEEPROM") {
       GetComandParams(s, params);
       // Serial.println("PARAM: " + params[0]);
       if (params[0] != "") {
+        // secondo parametro presente: scrittura paginata, le pagine hanno la dimensione della memoria selezionata
+        // terzo parametro a 1: ogni byte o pagina preceduto dalla sequenza di sblocco SDP
+        bool sdp = params[2] == "1";
+        // quarto parametro a 1: trasferimento compresso RLE (solo scrittura paginata)
+        bool rle = params[3] == "1";
         if (params[1] != "") {
-          writePagedEEPROM(params[0].toInt(), params[1].toInt());
+          writePagedEEPROM(params[0].toInt(), sdp, rle);
         } else {
-          writeEEPROM(params[0].toInt());
+          writeEEPROM(params[0].toInt(), sdp);
         }
         //Serial.println("+++");
       }
     }
     //**********************************************
+    // SCAN
+    //**********************************************
+    if (comand == "SCAN") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0] + "," + params[1]);
+      if (params[0] != "") {
+        // secondo parametro a 1: ogni pagina o byte preceduto dalla sequenza di sblocco SDP
+        scanEEPROM(params[0].toInt(), params[1] == "1");
+      }
+    }
+    //**********************************************
+    // FILL
+    //**********************************************
+    if (comand == "FILL") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0] + "," + params[1] + "," + params[2] + "," + params[3]);
+      FillPattern pattern;
+      if (params[0] != "" && params[1] != "" && GetFillPattern(params[2], pattern)) {
+        // quarto parametro a 1: ogni pagina preceduta dalla sequenza di sblocco SDP
+        unsigned int errors;
+        if (fillEEPROM(params[0].toInt(), params[1].toInt(), pattern, params[3] == "1", errors)) {
+          hostSerial.println("+FILL=" + String(errors));
+        } else {
+          hostSerial.println("+FILL=ABORT");
+        }
+      }
+    }
+    //**********************************************
+    // PROBE
+    //**********************************************
+    if (comand == "PROBE") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0]);
+      if (params[0] == "?") {
+        unsigned int size;
+        bool sdp;
+        probeEEPROM(size, sdp);
+        hostSerial.println("+PROBE=" + (String)size + "," + String(sdp));
+      }
+    }
+    //**********************************************
+    // TUNE
+    //**********************************************
+    if (comand == "TUNE") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0]);
+      if (params[0] != "") {
+        if (tuneTiming(params[0].toInt())) {
+          hostSerial.println("+TUNE=" + GetTiming());
+        } else {
+          hostSerial.println("+TUNE=-1");
+        }
+      }
+    }
+    //**********************************************
+    // TIMING
+    //**********************************************
+    if (comand == "TIMING") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0] + "," + params[1] + "," + params[2] + "," + params[3]);
+      if (params[0] == "?") {
+        hostSerial.println("+TIMING=" + GetTiming());
+      }
+      else if (params[3] != "") {
+        // Impostazione manuale del profilo, salvato nella EEPROM interna
+        timing.setup = constrain(params[0].toInt(), 0, TIMING_MAX);
+        timing.access = constrain(params[1].toInt(), 0, TIMING_MAX);
+        timing.pulse = constrain(params[2].toInt(), 0, TIMING_MAX);
+        timing.hold = constrain(params[3].toInt(), 0, TIMING_MAX);
+        saveTiming();
+        hostSerial.println("+TIMING=" + GetTiming());
+      }
+    }
+    //**********************************************
     // ENABLESDP
     //**********************************************
     if (comand == "ENABLESDP") {
@@ -151,13 +340,45 @@ void ParseComands(String s) {
       // Serial.println("PARAM: " + params[0]);
       if (params[0] == "1") {
         enableSDP();
-        Serial.println("+ENABLESDP=1");
+        hostSerial.println("+ENABLESDP=1");
       }
       else if (params[0] == "0") {
         disableSDP();
-        Serial.println("+ENABLESDP=0");
+        hostSerial.println("+ENABLESDP=0");
+      }
+    }
+    //**********************************************
+    // SELFTEST
+    //**********************************************
+    if (comand == "SELFTEST") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0]);
+      if (params[0] != "") {
+        // Linee bloccate e in corto: indirizzo bloccate, indirizzo in corto, dati bloccate, dati in corto
+        SelfTestResult result;
+        selfTestEEPROM(params[0].toInt(), result);
+        hostSerial.println("+SELFTEST=" + String(result.addressStuck) + "," + String(result.addressShort) + "," +
+                           String(result.dataStuck) + "," + String(result.dataShort));
+      }
+    }
+    //**********************************************
+    // DIAG
+    //**********************************************
+    if (comand == "DIAG") {
+      GetComandParams(s, params);
+      // Serial.println("PARAM: " + params[0]);
+      if (params[0] == "?") {
+        diagReport();
+      }
+      else if (params[0] == "0") {
+        // Azzera i contatori, la memoria minima riparte da quella libera attuale
+        diagReset();
+        hostSerial.println(F("+DIAG=0"));
       }
     }
+
+    // Durata del comando (DIAG)
+    diagCommand(comand.c_str(), micros() - start);
   }
 }
 
@@ -169,6 +390,44 @@ String GetComand(String s) {
   return s.substring(0, i);
 }
 
+// Ritorna il profilo di temporizzazione in uso (setup,access,pulse,hold)
+String GetTiming() {
+  return String(timing.setup) + "," + String(timing.access) + "," + String(timing.pulse) + "," + String(timing.hold);
+}
+
+// Ritorna la memoria selezionata (nome,dimensione,bytes per pagina,sdp,tWC)
+String GetChip() {
+  return String(chip->name) + "," + String(chip->size) + "," + String(chip->pageSize) + "," + String(chip->sdp) + "," + String(chip->writeCycle);
+}
+
+// Decodifica lo schema di FILL: ADDR, ADDRX o sequenza esadecimale di massimo FILL_MAX_PATTERN bytes (es. EA, 55AA)
+bool GetFillPattern(String s, FillPattern &pattern) {
+  if (s == "ADDR") {
+    pattern.mode = FILL_ADDR;
+    return true;
+  }
+  if (s == "ADDRX") {
+    pattern.mode = FILL_ADDRX;
+    return true;
+  }
+
+  unsigned int l = s.length();
+  if (l == 0 || l % 2 != 0 || l / 2 > FILL_MAX_PATTERN) {
+    return false;
+  }
+  pattern.mode = FILL_BYTES;
+  pattern.len = l / 2;
+  for (byte i = 0; i < pattern.len; i++) {
+    char* end;
+    String hex = s.substring(i * 2, i * 2 + 2);
+    pattern.data[i] = strtoul(hex.c_str(), &end, 16);
+    if (*end != '\0') {
+      return false;
+    }
+  }
+  return true;
+}
+
 // Ritorna lista parametri
 void GetComandParams(String s, String(&params)[10]) {
   int index = s.indexOf('=');
@@ -199,11 +458,15 @@ char receivedChars[64] = "";
 int rcIndex = 0;
 
 String ReadSerialComand(){
-  while (Serial.available()) {
-    if (rcIndex > 63) rcIndex = 0;
+  while (hostSerial.available()) {
+    if (rcIndex > 63) {
+      // Comando più lungo del buffer, viene troncato
+      rcIndex = 0;
+      diag.commandOverflows++;
+    }
     
     // Legge carattere dalla seriale
-    char rc = Serial.read();
+    char rc = hostSerial.read();
     // Carattere di fine comando
     if (rc == '\n' or rc == '\r') {
       receivedChars[rcIndex] = '\0';
@@ -0,0 +1,16 @@
+/*
+  AT28C_Programmer.ino - Programmatore EEPROM AT28C
+  Copyright (C) 2023 DrVector
+
+  Tabella delle memorie supportate, condivisa con il programma host (solo macro, valida in C e C++)
+*/
+
+//******************************************************************************************************************//
+//* CHIP(nome, dimensione in bytes, bytes per pagina (1 = solo scrittura a byte), SDP (0/1), tWC massimo in ms)
+//* Per aggiungere una memoria è sufficiente una nuova riga, firmware e host ne ricavano i rispettivi descrittori
+//******************************************************************************************************************//
+#define AT28C_CHIPS(CHIP) \
+  CHIP(AT28C16,  2048,  1,  0, 1)  \
+  CHIP(AT28C64,  8192,  1,  0, 1)  \
+  CHIP(AT28C64B, 8192,  64, 1, 10) \
+  CHIP(AT28C256, 32768, 64, 1, 10)
@@ -34,4 +34,64 @@ const int EEPROM_CE_PIN = A2;
 const int dataPins[] = 
 {
     2, 3, 4, 5, 6, 7, 8, 9
-};
\ No newline at end of file
+};
+
+//******************************************************************************************************************//
+//* Timeout trasferimenti
+//******************************************************************************************************************//
+// Timeout tra due bytes di un trasferimento dati dall'host (ms), allo scadere il trasferimento viene interrotto
+const unsigned long STREAM_TIMEOUT = 100;
+// Tempo massimo di attesa del termine di un ciclo di scrittura (ms)
+const unsigned int WRITE_TIMEOUT = 20;
+// Carattere di interruzione dei trasferimenti dal programmatore all'host
+const byte ABORT_CHAR = 0x1B;
+
+//******************************************************************************************************************//
+//* Temporizzazioni del bus EEPROM
+//******************************************************************************************************************//
+// Attesa massima (us) di ciascun parametro di temporizzazione, profilo sicuro usato come riferimento da TUNE
+const byte TIMING_MAX = 4;
+// Indirizzo nella EEPROM interna del Nano del profilo di temporizzazione salvato
+const int TIMING_EEPROM_ADDRESS = 0;
+// Bytes della EEPROM utilizzati come area di prova da TUNE
+const byte TUNE_BYTES = 16;
+// Letture ripetute di verifica di ogni profilo di prova
+const byte TUNE_READS = 8;
+
+//******************************************************************************************************************//
+//* Lettura con campionamento multiplo
+//******************************************************************************************************************//
+// Numero massimo di campioni per indirizzo
+const byte VOTE_MAX_SAMPLES = 31;
+
+//******************************************************************************************************************//
+//* Programmazione di uno schema (FILL)
+//******************************************************************************************************************//
+// Lunghezza massima di uno schema ripetuto
+const byte FILL_MAX_PATTERN = 8;
+
+//******************************************************************************************************************//
+//* Diagnostica (DIAG)
+//******************************************************************************************************************//
+// Numero di comandi con statistiche di durata separate (l'ultimo raccoglie i comandi non riconosciuti)
+const byte DIAG_COMMANDS = 23;
+// Durata massima registrata per un comando (us), le durate superiori vengono riportate con questo valore
+const unsigned int DIAG_MAX_US = 65535;
+// Valore di riempimento della SRAM libera, la parte non sovrascritta indica la minima memoria libera dall'avvio
+const byte DIAG_CANARY = 0xA5;
+// Bytes di stack lasciati intatti sotto il frame corrente durante il riempimento
+const byte DIAG_STACK_MARGIN = 32;
+
+//******************************************************************************************************************//
+//* Verifica del bus (SELFTEST)
+//******************************************************************************************************************//
+// Valori di prova per serie: uno per la base e uno per ciascuna delle 15 linee di indirizzo
+const byte SELFTEST_VALUES = 16;
+
+//******************************************************************************************************************//
+//* Misura dei cicli di scrittura (SCAN)
+//******************************************************************************************************************//
+// Bytes per blocco misurato delle memorie senza scrittura paginata (ogni byte ha il proprio ciclo di scrittura)
+const byte SCAN_BLOCK = 64;
+// Durata riportata per un ciclo di scrittura non terminato entro il timeout
+const unsigned int SCAN_TIMEOUT = 0xFFFF;
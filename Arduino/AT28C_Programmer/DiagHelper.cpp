@@ -0,0 +1,214 @@
+/*  
+  AT28C_Programmer.ino - Programmatore EEPROM AT28C
+  Copyright (C) 2023 DrVector
+  
+  Helper contatori diagnostici (DIAG)
+*/
+
+#include <Arduino.h>
+#include "Const.h"
+#include "DiagHelper.h"
+
+//******************************************************************************************************************//
+//* Contatori
+//******************************************************************************************************************//
+DiagCounters diag;
+
+// Durata dei comandi: esecuzioni, durata totale e massima (us), la massima è limitata a DIAG_MAX_US
+// per contenere la tabella in SRAM (i nomi, costanti, sono in flash)
+struct DiagCommandTime {
+  unsigned int count;
+  unsigned long total;
+  unsigned int max;
+};
+
+DiagCommandTime diagCommands[DIAG_COMMANDS];
+
+// Nomi dei comandi in flash separati da virgola, nello stesso ordine di diagCommands (OTHER = non riconosciuto)
+const char diagNames[] PROGMEM = "ECHO,SYNC,VERSION,RLE,RXBUFFER,CHIP,READBYTE,WRITEBYTE,READEEPROM,READVOTE,READBLOCKS,"
+                                 "CHECKSUM,BLOCKSUMS,WRITEEEPROM,SCAN,FILL,PROBE,TUNE,TIMING,ENABLESDP,SELFTEST,DIAG,OTHER";
+
+// Limiti della memoria gestita da malloc (avr-libc)
+extern char __heap_start;
+extern char* __brkval;
+
+//******************************************************************************************************************//
+//* Seriale verso l'host
+//******************************************************************************************************************//
+DiagSerial hostSerial;
+
+void DiagSerial::begin(unsigned long baud) {
+  Serial.begin(baud);
+}
+
+int DiagSerial::available() {
+  return Serial.available();
+}
+
+int DiagSerial::read() {
+  // il buffer circolare del core contiene al massimo SERIAL_RX_BUFFER_SIZE - 1 bytes
+  if (Serial.available() >= SERIAL_RX_BUFFER_SIZE - 1) {
+    diag.rxFull++;
+  }
+  int c = Serial.read();
+  if (c >= 0) {
+    diag.bytesIn++;
+  }
+  return c;
+}
+
+int DiagSerial::peek() {
+  return Serial.peek();
+}
+
+void DiagSerial::flush() {
+  Serial.flush();
+}
+
+size_t DiagSerial::write(uint8_t value) {
+  diag.bytesOut++;
+  return Serial.write(value);
+}
+
+size_t DiagSerial::write(const uint8_t* buffer, size_t size) {
+  diag.bytesOut += size;
+  return Serial.write(buffer, size);
+}
+
+//******************************************************************************************************************//
+//* Memoria libera tra heap e stack
+//******************************************************************************************************************//
+char* diagHeapEnd() {
+  return __brkval != 0 ? __brkval : &__heap_start;
+}
+
+void diagBegin() {
+  // riempie dalla fine dello heap fino al frame corrente, escluso un margine per le chiamate in corso
+  char* top = (char*)SP - DIAG_STACK_MARGIN;
+  for (char* p = diagHeapEnd(); p < top; p++) {
+    *p = DIAG_CANARY;
+  }
+}
+
+// Sequenza più lunga di bytes mai sovrascritti da heap e stack
+unsigned int diagMinFree() {
+  unsigned int best = 0;
+  unsigned int run = 0;
+  for (char* p = &__heap_start; p < (char*)SP; p++) {
+    if ((byte)*p == DIAG_CANARY) {
+      run++;
+      if (run > best) {
+        best = run;
+      }
+    } else {
+      run = 0;
+    }
+  }
+  return best;
+}
+
+//******************************************************************************************************************//
+//* Durate
+//******************************************************************************************************************//
+void diagLoop(unsigned long us) {
+  diag.loops++;
+  if (us > diag.loopMax) {
+    diag.loopMax = min(us, 65535UL);
+  }
+}
+
+// Indice del comando nella lista dei nomi, l'ultimo (OTHER) se non riconosciuto
+byte diagCommandIndex(const char* comand) {
+  const char* p = diagNames;
+  for (byte i = 0; i < DIAG_COMMANDS - 1; i++) {
+    // confronta il nome fino alla virgola
+    byte j = 0;
+    char c;
+    while ((c = pgm_read_byte(p + j)) != ',' && c == comand[j]) {
+      j++;
+    }
+    if (c == ',' && comand[j] == '\0') {
+      return i;
+    }
+    while (pgm_read_byte(p) != ',') {
+      p++;
+    }
+    p++;
+  }
+  return DIAG_COMMANDS - 1;
+}
+
+void diagCommand(const char* comand, unsigned long us) {
+  DiagCommandTime &t = diagCommands[diagCommandIndex(comand)];
+  t.count++;
+  t.total += us;
+  if (us > t.max) {
+    t.max = min(us, (unsigned long)DIAG_MAX_US);
+  }
+}
+
+//******************************************************************************************************************//
+//* Azzeramento e invio dei contatori
+//******************************************************************************************************************//
+void diagReset() {
+  memset(&diag, 0, sizeof(diag));
+  memset(diagCommands, 0, sizeof(diagCommands));
+  diagBegin();
+}
+
+void diagReport() {
+  hostSerial.print(F("+DIAG=UPTIME,"));
+  hostSerial.println(millis());
+
+  hostSerial.print(F("+DIAG=LOOP,"));
+  hostSerial.print(diag.loops);
+  hostSerial.print(',');
+  hostSerial.println(diag.loopMax);
+
+  hostSerial.print(F("+DIAG=SERIAL,"));
+  hostSerial.print(diag.bytesIn);
+  hostSerial.print(',');
+  hostSerial.print(diag.bytesOut);
+  hostSerial.print(',');
+  hostSerial.print(diag.rxFull);
+  hostSerial.print(',');
+  hostSerial.print(diag.commandOverflows);
+  hostSerial.print(',');
+  hostSerial.println(diag.streamTimeouts);
+
+  hostSerial.print(F("+DIAG=SRAM,"));
+  hostSerial.print((unsigned int)((char*)SP - diagHeapEnd()));
+  hostSerial.print(',');
+  hostSerial.println(diagMinFree());
+
+  hostSerial.print(F("+DIAG=WRITE,"));
+  hostSerial.print(diag.writeCycles);
+  hostSerial.print(',');
+  hostSerial.print(diag.writeWait);
+  hostSerial.print(',');
+  hostSerial.println(diag.writeTimeouts);
+
+  // solo i comandi eseguiti almeno una volta: nome,esecuzioni,durata totale,durata massima (us)
+  const char* p = diagNames;
+  for (byte i = 0; i < DIAG_COMMANDS; i++) {
+    if (diagCommands[i].count > 0) {
+      hostSerial.print(F("+DIAG=CMD,"));
+      char c;
+      for (byte j = 0; (c = pgm_read_byte(p + j)) != ',' && c != '\0'; j++) {
+        hostSerial.write(c);
+      }
+      hostSerial.print(',');
+      hostSerial.print(diagCommands[i].count);
+      hostSerial.print(',');
+      hostSerial.print(diagCommands[i].total);
+      hostSerial.print(',');
+      hostSerial.println(diagCommands[i].max);
+    }
+    while (pgm_read_byte(p) != ',' && pgm_read_byte(p) != '\0') {
+      p++;
+    }
+    p++;
+  }
+
+  hostSerial.println(F("+DIAG=END"));
+}
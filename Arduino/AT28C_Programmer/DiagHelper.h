@@ -0,0 +1,74 @@
+/*  
+  AT28C_Programmer.ino - Programmatore EEPROM AT28C
+  Copyright (C) 2023 DrVector
+  
+  Helper contatori diagnostici (DIAG)
+*/
+
+#include <Arduino.h>
+
+//******************************************************************************************************************//
+//* Contatori dall'avvio o dall'ultimo DIAG=0, ogni aggiornamento costa poche istruzioni
+//******************************************************************************************************************//
+struct DiagCounters {
+  // bytes ricevuti e inviati sulla seriale
+  unsigned long bytesIn;
+  unsigned long bytesOut;
+  // letture con il buffer di ricezione del core pieno (i bytes in arrivo in quel momento possono essere persi)
+  unsigned int rxFull;
+  // comandi più lunghi del buffer dei comandi (troncati)
+  unsigned int commandOverflows;
+  // trasferimenti dall'host interrotti per timeout tra due bytes
+  unsigned int streamTimeouts;
+  // cicli di loop senza comandi e durata massima (us)
+  unsigned long loops;
+  unsigned int loopMax;
+  // cicli di scrittura attesi, attesa totale (ms) e cicli non terminati entro il timeout
+  unsigned long writeCycles;
+  unsigned long writeWait;
+  unsigned int writeTimeouts;
+};
+
+extern DiagCounters diag;
+
+//******************************************************************************************************************//
+//* Seriale verso l'host con conteggio dei bytes in transito
+//******************************************************************************************************************//
+class DiagSerial : public Stream {
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  int peek();
+  void flush();
+  size_t write(uint8_t value);
+  size_t write(const uint8_t* buffer, size_t size);
+  using Print::write;
+};
+
+extern DiagSerial hostSerial;
+
+//******************************************************************************************************************//
+//* Riempie la SRAM libera per la misura della minima memoria libera (da chiamare all'avvio)
+//******************************************************************************************************************//
+void diagBegin();
+
+//******************************************************************************************************************//
+//* Registra la durata di un ciclo di loop senza comandi
+//******************************************************************************************************************//
+void diagLoop(unsigned long us);
+
+//******************************************************************************************************************//
+//* Registra la durata di un comando
+//******************************************************************************************************************//
+void diagCommand(const char* comand, unsigned long us);
+
+//******************************************************************************************************************//
+//* Azzera i contatori e riempie nuovamente la SRAM libera
+//******************************************************************************************************************//
+void diagReset();
+
+//******************************************************************************************************************//
+//* Invia all'host i contatori, una riga +DIAG= per gruppo terminate da +DIAG=END
+//******************************************************************************************************************//
+void diagReport();
@@ -0,0 +1,115 @@
+/*  
+  AT28C_Programmer.ino - Programmatore EEPROM AT28C
+  Copyright (C) 2023 DrVector
+  
+  Helper compressione RLE dei trasferimenti
+*/
+
+#include <Arduino.h>
+#include "Const.h"
+#include "AT28C.h"
+#include "RLEHelper.h"
+#include "DiagHelper.h"
+
+// Lunghezza massima di una sequenza letterale e di una ripetizione
+#define RLE_MAX_LITERAL 128
+#define RLE_MAX_RUN 129
+
+//******************************************************************************************************************//
+//* Compressione verso l'host
+//******************************************************************************************************************//
+byte rleLiteral[RLE_MAX_LITERAL];
+byte rleLiteralLen = 0;
+byte rleRunValue = 0;
+byte rleRunLen = 0;
+
+void rleFlushLiteral() {
+  if (rleLiteralLen > 0) {
+    byte c = rleLiteralLen - 1;
+    hostSerial.write(&c, 1);
+    hostSerial.write(rleLiteral, rleLiteralLen);
+    rleLiteralLen = 0;
+  }
+}
+
+void rleAddLiteral(byte value) {
+  rleLiteral[rleLiteralLen++] = value;
+  if (rleLiteralLen == RLE_MAX_LITERAL) {
+    rleFlushLiteral();
+  }
+}
+
+void rleFlushRun() {
+  // Le ripetizioni di 1 o 2 bytes non vengono compresse
+  if (rleRunLen >= 3) {
+    rleFlushLiteral();
+    byte c = 0x80 | (rleRunLen - 2);
+    hostSerial.write(&c, 1);
+    hostSerial.write(&rleRunValue, 1);
+  } else {
+    for (byte i = 0; i < rleRunLen; i++) {
+      rleAddLiteral(rleRunValue);
+    }
+  }
+  rleRunLen = 0;
+}
+
+void rleBeginWrite() {
+  rleLiteralLen = 0;
+  rleRunLen = 0;
+}
+
+void rleWrite(byte value) {
+  if (rleRunLen > 0 && value == rleRunValue && rleRunLen < RLE_MAX_RUN) {
+    rleRunLen++;
+    return;
+  }
+  rleFlushRun();
+  rleRunValue = value;
+  rleRunLen = 1;
+}
+
+void rleEndWrite() {
+  rleFlushRun();
+  rleFlushLiteral();
+}
+
+//******************************************************************************************************************//
+//* Decompressione dall'host
+//******************************************************************************************************************//
+byte rleInLiteral = 0;
+byte rleInRun = 0;
+byte rleInValue = 0;
+
+void rleBeginRead() {
+  rleInLiteral = 0;
+  rleInRun = 0;
+}
+
+int rleRead() {
+  if (rleInRun > 0) {
+    rleInRun--;
+    return rleInValue;
+  }
+
+  if (rleInLiteral == 0) {
+    int c = readStreamByte();
+    if (c == -1) {
+      return -1;
+    }
+    if (c & 0x80) {
+      int value = readStreamByte();
+      if (value == -1) {
+        return -1;
+      }
+      // il primo byte della ripetizione viene ritornato subito
+      rleInValue = value;
+      rleInRun = (c & 0x7F) + 1;
+      return value;
+    }
+    rleInLiteral = c + 1;
+  }
+
+  rleInLiteral--;
+  return readStreamByte();
+}
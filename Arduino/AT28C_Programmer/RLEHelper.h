@@ -0,0 +1,39 @@
+/*  
+  AT28C_Programmer.ino - Programmatore EEPROM AT28C
+  Copyright (C) 2023 DrVector
+  
+  Helper compressione RLE dei trasferimenti
+*/
+
+#include <Arduino.h>
+
+//******************************************************************************************************************//
+//* Formato: byte di controllo c
+//*   c < 0x80: seguono c + 1 bytes letterali
+//*   c >= 0x80: il byte successivo va ripetuto (c & 0x7F) + 2 volte
+//******************************************************************************************************************//
+
+//******************************************************************************************************************//
+//* Inizializza la compressione dei bytes inviati all'host
+//******************************************************************************************************************//
+void rleBeginWrite();
+
+//******************************************************************************************************************//
+//* Comprime e invia un byte all'host
+//******************************************************************************************************************//
+void rleWrite(byte value);
+
+//******************************************************************************************************************//
+//* Invia all'host i bytes ancora in attesa di compressione
+//******************************************************************************************************************//
+void rleEndWrite();
+
+//******************************************************************************************************************//
+//* Inizializza la decompressione dei bytes ricevuti dall'host
+//******************************************************************************************************************//
+void rleBeginRead();
+
+//******************************************************************************************************************//
+//* Ritorna il successivo byte decompresso ricevuto dall'host, -1 allo scadere del timeout di trasferimento
+//******************************************************************************************************************//
+int rleRead();
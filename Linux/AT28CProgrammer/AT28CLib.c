@@ -0,0 +1,1155 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "AT28CLib.h"
+
+// tabella delle memorie supportate, condivisa con il firmware
+#include "Chips.h"
+
+// dimensione dei blocchi delle letture verificate da CRC
+#define READ_BLOCK_SIZE 256
+
+// tentativi di lettura di un blocco corrotto prima di abbandonare l'operazione
+#define READ_RETRIES 3
+
+// timeout tra due bytes di un trasferimento verso il programmatore (ms), allo scadere il firmware lo interrompe
+#define STREAM_TIMEOUT_MS 100
+
+// carattere di interruzione dei trasferimenti dal programmatore all'host
+#define ABORT_CHAR 0x1B
+
+// intervallo tra le richieste di versione e attesa massima della connessione senza reset (ms)
+#define CONNECT_PROBE_MS 20
+#define CONNECT_TIMEOUT_MS 2000
+
+// attese della connessione con reset (ms): avvio della seriale, intestazione del programmatore, risposta alla versione
+#define BOOT_DELAY_MS 100
+#define HEADER_TIMEOUT_MS 1500
+#define VERSION_TIMEOUT_MS 100
+
+// attesa massima di una risposta o del byte successivo di un trasferimento dal programmatore (ms)
+#define ANSWER_TIMEOUT_MS 500
+
+// dati residui scartati al massimo da un riallineamento (bytes e ms, oltre una lettura completa della memoria
+// più grande), oltre il limite il programmatore non risponde come atteso
+#define DRAIN_MAX_BYTES 65536
+#define DRAIN_TIMEOUT_MS 5000
+
+// attesa massima dei primi bytes di una scrittura da flusso, prima dell'invio del comando (ms)
+#define STREAM_START_TIMEOUT_MS 60000
+
+// lunghezza massima di una riga e di una risposta su più righe (BLOCKSUMS della memoria più grande a blocchi
+// di 256 bytes)
+#define LINE_SIZE 1024
+
+// formato RLE del firmware: byte di controllo c < 0x80 seguito da c + 1 bytes letterali,
+// byte di controllo c >= 0x80 seguito da un byte da ripetere (c & 0x7F) + 2 volte
+#define RLE_MAX_LITERAL 128
+#define RLE_MAX_RUN 129
+
+// pagina più grande delle scritture compresse RLE
+#define RLE_PAGE_MAX 256
+
+#define CHIP_DESCRIPTOR(NAME, SIZE, PAGE, SDP, TWC) { #NAME, SIZE, PAGE, SDP, TWC },
+static const at28c_chip chips[] = {
+  AT28C_CHIPS(CHIP_DESCRIPTOR)
+};
+
+// operazioni della sessione
+typedef enum {
+  OP_NONE,
+  OP_CONNECT,
+  OP_CHIP,
+  OP_READ,
+  OP_VERIFY,
+  OP_WRITE,
+  OP_SDP,
+  OP_REQUEST,
+  OP_SYNC
+} e_operation;
+
+// fasi delle operazioni
+typedef enum {
+  // nessuna operazione in corso
+  ST_IDLE,
+  // connessione con reset: avvio della seriale, prima risposta alla versione, intestazione, seconda risposta
+  ST_BOOT,
+  ST_FIRST_VERSION,
+  ST_HEADER,
+  ST_VERSION,
+  // connessione senza reset: richieste di versione ravvicinate
+  ST_PROBE,
+  // attesa di una riga di risposta
+  ST_ANSWER,
+  // ricezione dei blocchi verificati da CRC
+  ST_BLOCKS,
+  // ricezione del flusso continuo della memoria
+  ST_DATA,
+  // scrittura da flusso: attesa della prima pagina o finestra dell'immagine, il comando non è ancora inviato
+  ST_STREAM,
+  // invio dell'immagine e ricezione dei bytes riletti
+  ST_WRITE,
+  // riallineamento: attesa della linea libera e conferma SYNC
+  ST_DRAIN,
+  ST_SYNC
+} e_state;
+
+struct at28c_session {
+  int fd;
+  bool keepalive;
+  char version[32];
+  const at28c_chip* chip;
+  at28c_trace trace;
+  void* traceuser;
+
+  // operazione in corso, fase, risultato e notifiche
+  e_operation op;
+  e_state state;
+  int status;
+  at28c_callbacks callbacks;
+  // scadenza della fase corrente (us)
+  long long deadline;
+
+  // connessione: richieste di versione inviate e scadenza complessiva (us)
+  int probes;
+  long long timeout;
+
+  // riga di risposta in ricezione, prefisso atteso, riga finale e attesa massima tra due bytes (ms)
+  char line[LINE_SIZE];
+  size_t linelen;
+  char expected[32];
+  char last[32];
+  long wait;
+
+  // righe raccolte della risposta di una richiesta
+  char answer[LINE_SIZE];
+  size_t answerlen;
+
+  // trasferimento: buffer del chiamante, area, bytes dell'immagine disponibili, inviati e completati
+  unsigned char* data;
+  const unsigned char* image;
+  size_t start;
+  size_t len;
+  size_t available;
+  size_t sent;
+  size_t done;
+  bool paged;
+  bool sdp;
+  int window;
+  bool blocked;
+  size_t errors;
+  long erroraddr;
+
+  // trasferimento compresso RLE: stato della decompressione dei bytes ricevuti, pagina compressa in invio
+  // e bytes già accettati dalla seriale
+  bool rle;
+  int literal;
+  bool run;
+  unsigned char encoded[RLE_PAGE_MAX + RLE_PAGE_MAX / RLE_MAX_LITERAL + 1];
+  size_t enclen;
+  size_t encsent;
+
+  // flusso continuo: bytes ricevuti dall'indirizzo 0
+  size_t received;
+
+  // blocco verificato in ricezione, fine dei blocchi richiesti e tentativi residui del blocco atteso
+  unsigned char frame[READ_BLOCK_SIZE + 4];
+  size_t framelen;
+  size_t requested;
+  int retries;
+
+  // connessione con reset: ricevuta almeno una parte dell'intestazione
+  bool header;
+
+  // riallineamento: risultato da notificare al termine (AT28C_BUSY riprende la lettura), silenzio atteso (ms),
+  // bytes scartati con la relativa scadenza (us) e numero della conferma SYNC
+  int pending;
+  long silence;
+  size_t drained;
+  long long drainend;
+  unsigned int token;
+};
+
+// restituisce un tempo monotono in microsecondi
+static long long nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// comprime un buffer in formato RLE, dst deve avere spazio per almeno len + len / RLE_MAX_LITERAL + 1 bytes
+static size_t rleEncode(const unsigned char* src, size_t len, unsigned char* dst) {
+  size_t out = 0;
+  size_t literal = 0;
+  size_t idx = 0;
+  while (idx < len) {
+    size_t run = 1;
+    while (idx + run < len && src[idx + run] == src[idx] && run < RLE_MAX_RUN) {
+      run++;
+    }
+    // le ripetizioni di 1 o 2 bytes non vengono compresse
+    if (run >= 3) {
+      if (literal) {
+        dst[out++] = literal - 1;
+        memcpy(dst + out, src + idx - literal, literal);
+        out += literal;
+        literal = 0;
+      }
+      dst[out++] = 0x80 | (run - 2);
+      dst[out++] = src[idx];
+      idx += run;
+    } else {
+      literal++;
+      idx++;
+      if (literal == RLE_MAX_LITERAL) {
+        dst[out++] = literal - 1;
+        memcpy(dst + out, src + idx - literal, literal);
+        out += literal;
+        literal = 0;
+      }
+    }
+  }
+  if (literal) {
+    dst[out++] = literal - 1;
+    memcpy(dst + out, src + idx - literal, literal);
+    out += literal;
+  }
+  return out;
+}
+
+// decodifica un byte ricevuto, ritorna il numero di bytes della memoria prodotti in out (max RLE_MAX_RUN,
+// nessuno per i bytes di controllo del trasferimento compresso)
+static int decodeByte(at28c_session* s, unsigned char c, unsigned char* out) {
+  if (!s->rle) {
+    out[0] = c;
+    return 1;
+  }
+  if (s->run) {
+    // valore della ripetizione
+    int count = s->literal;
+    memset(out, c, count);
+    s->run = false;
+    s->literal = 0;
+    return count;
+  }
+  if (s->literal > 0) {
+    s->literal--;
+    out[0] = c;
+    return 1;
+  }
+  // byte di controllo
+  if (c & 0x80) {
+    s->run = true;
+    s->literal = (c & 0x7F) + 2;
+  } else {
+    s->literal = c + 1;
+  }
+  return 0;
+}
+
+// scrive sulla seriale registrando i bytes inviati
+static ssize_t sessionWrite(at28c_session* s, const void* buf, size_t len) {
+  ssize_t n = write(s->fd, buf, len);
+  if (n > 0 && s->trace != NULL) {
+    s->trace('>', buf, n, s->traceuser);
+  }
+  return n;
+}
+
+// invia un comando, ritorna -1 se non viene accettato interamente dalla seriale
+static int sendCommand(at28c_session* s, const char* cmd) {
+  size_t len = strlen(cmd);
+  return sessionWrite(s, cmd, len) == (ssize_t)len ? 0 : -1;
+}
+
+// imposta la scadenza della fase corrente
+static void setDeadline(at28c_session* s, long msec) {
+  s->deadline = nowMicros() + msec * 1000LL;
+}
+
+// termina l'operazione e notifica il risultato (il callback può avviare l'operazione successiva)
+static void finish(at28c_session* s, int result) {
+  s->op = OP_NONE;
+  s->state = ST_IDLE;
+  s->status = result;
+  if (s->callbacks.done != NULL) {
+    s->callbacks.done(s, result, s->callbacks.user);
+  }
+}
+
+// riallinea il programmatore e termina con result, con abort interrompe prima il trasferimento verso l'host
+static void resync(at28c_session* s, bool abort, int result) {
+  if (abort) {
+    unsigned char c = ABORT_CHAR;
+    sessionWrite(s, &c, 1);
+  }
+  s->pending = result;
+  s->state = ST_DRAIN;
+  s->silence = STREAM_TIMEOUT_MS + 50;
+  s->drained = 0;
+  s->drainend = nowMicros() + DRAIN_TIMEOUT_MS * 1000LL;
+  setDeadline(s, s->silence);
+}
+
+// avvia una operazione se la sessione è inattiva
+static int begin(at28c_session* s, e_operation op, const at28c_callbacks* callbacks) {
+  if (s->op != OP_NONE) {
+    return -1;
+  }
+  s->op = op;
+  s->status = AT28C_BUSY;
+  s->linelen = 0;
+  s->rle = false;
+  s->literal = 0;
+  s->run = false;
+  if (callbacks != NULL) {
+    s->callbacks = *callbacks;
+  } else {
+    memset(&s->callbacks, 0, sizeof(s->callbacks));
+  }
+  tcflush(s->fd, TCIOFLUSH);
+  return 0;
+}
+
+// invia un comando e attende la riga di risposta con il prefisso indicato, ogni byte per max msec millisecondi
+static int beginAnswer(at28c_session* s, const char* cmd, const char* expected, long msec) {
+  strcpy(s->expected, expected);
+  if (sendCommand(s, cmd) == -1) {
+    s->op = OP_NONE;
+    s->status = AT28C_ERROR;
+    return -1;
+  }
+  s->state = ST_ANSWER;
+  s->wait = msec;
+  setDeadline(s, s->wait);
+  return 0;
+}
+
+// notifica l'avanzamento del trasferimento
+static void notifyProgress(at28c_session* s) {
+  if (s->callbacks.progress != NULL) {
+    s->callbacks.progress(s, s->done, s->len, s->callbacks.user);
+  }
+}
+
+// registra un byte riletto diverso dall'immagine
+static void notifyMismatch(at28c_session* s, size_t address, unsigned char expected, unsigned char actual) {
+  if (s->errors == 0) {
+    s->erroraddr = address;
+  }
+  s->errors++;
+  if (s->callbacks.mismatch != NULL) {
+    s->callbacks.mismatch(s, address, expected, actual, s->callbacks.user);
+  }
+}
+
+// richiede i blocchi verificati non ancora ricevuti, con single solo il blocco atteso (ripetizione)
+static void requestBlocks(at28c_session* s, bool single) {
+  size_t len = s->len - s->done;
+  if (single && len > READ_BLOCK_SIZE) {
+    len = READ_BLOCK_SIZE;
+  }
+  s->requested = s->done + len;
+  char cmd[64];
+  sprintf(cmd, "READBLOCKS=%zu,%zu,%d\r", s->start + s->done, len, READ_BLOCK_SIZE);
+  s->framelen = 0;
+  if (sendCommand(s, cmd) == -1) {
+    finish(s, AT28C_ERROR);
+    return;
+  }
+  s->state = ST_BLOCKS;
+  setDeadline(s, ANSWER_TIMEOUT_MS);
+}
+
+// blocco corrotto o trasferimento interrotto: richiede di nuovo il solo blocco atteso o abbandona esauriti
+// i tentativi del blocco
+static void retryBlocks(at28c_session* s, bool abort) {
+  s->retries--;
+  resync(s, abort, s->retries >= 0 ? AT28C_BUSY : AT28C_ERROR);
+}
+
+// riceve un byte dei blocchi verificati: indirizzo (2 bytes), dati, CRC16 di indirizzo e dati (2 bytes)
+static void receiveBlockByte(at28c_session* s, unsigned char c) {
+  size_t address = s->start + s->done;
+  size_t n = s->len - s->done < READ_BLOCK_SIZE ? s->len - s->done : READ_BLOCK_SIZE;
+  s->frame[s->framelen++] = c;
+  if (s->framelen < n + 4) {
+    return;
+  }
+
+  unsigned short crc = at28cCrc16(0xFFFF, s->frame, n + 2);
+  if (s->frame[0] != ((address >> 8) & 0xFF) || s->frame[1] != (address & 0xFF) ||
+      s->frame[n + 2] != (crc >> 8) || s->frame[n + 3] != (crc & 0xFF)) {
+    retryBlocks(s, true);
+    return;
+  }
+
+  if (s->op == OP_READ) {
+    memcpy(s->data + s->done, s->frame + 2, n);
+  } else {
+    for (size_t idx = 0; idx < n; idx++) {
+      if (s->frame[2 + idx] != s->image[s->done + idx]) {
+        notifyMismatch(s, address + idx, s->image[s->done + idx], s->frame[2 + idx]);
+      }
+    }
+  }
+  s->done += n;
+  s->framelen = 0;
+  s->retries = READ_RETRIES;
+  notifyProgress(s);
+  if (s->done == s->len) {
+    finish(s, s->errors ? AT28C_MISMATCH : AT28C_OK);
+  } else if (s->done == s->requested) {
+    // blocco ripetuto ricevuto, richiede i successivi
+    requestBlocks(s, false);
+  }
+}
+
+// richiede il flusso continuo della memoria dall'indirizzo 0 fino alla fine dell'area
+static void requestStream(at28c_session* s) {
+  // il secondo parametro richiede il trasferimento compresso RLE
+  char cmd[48];
+  sprintf(cmd, "READEEPROM=%zu%s\r", s->start + s->len, s->rle ? ",1" : "");
+  s->received = 0;
+  if (sendCommand(s, cmd) == -1) {
+    finish(s, AT28C_ERROR);
+    return;
+  }
+  s->state = ST_DATA;
+  setDeadline(s, ANSWER_TIMEOUT_MS);
+}
+
+// riceve i bytes del flusso continuo, i bytes precedenti all'area richiesta vengono scartati
+static void receiveStreamBytes(at28c_session* s, const unsigned char* buf, size_t len) {
+  for (size_t idx = 0; idx < len && s->done < s->len; idx++) {
+    unsigned char out[RLE_MAX_RUN];
+    int n = decodeByte(s, buf[idx], out);
+    for (int pos = 0; pos < n && s->done < s->len; pos++) {
+      size_t address = s->received++;
+      if (address < s->start) {
+        continue;
+      }
+      if (s->op == OP_READ) {
+        s->data[s->done] = out[pos];
+      } else if (out[pos] != s->image[s->done]) {
+        notifyMismatch(s, address, s->image[s->done], out[pos]);
+      }
+      s->done++;
+    }
+  }
+  notifyProgress(s);
+  if (s->state != ST_DATA) {
+    // operazione interrotta dal callback
+    return;
+  }
+  if (s->done == s->len) {
+    finish(s, s->errors ? AT28C_MISMATCH : AT28C_OK);
+    return;
+  }
+  setDeadline(s, ANSWER_TIMEOUT_MS);
+}
+
+// invia la pagina successiva compressa RLE, solo completa e dopo la rilettura della precedente:
+// la pagina risulta inviata quando la seriale ne ha accettato tutti i bytes compressi
+static void sendEncodedPage(at28c_session* s) {
+  size_t end = s->sent + s->chip->pagesize < s->len ? s->sent + s->chip->pagesize : s->len;
+  if (s->enclen == 0) {
+    if (s->sent != s->done || s->available < end) {
+      s->blocked = false;
+      return;
+    }
+    // ogni pagina viene compressa separatamente
+    s->enclen = rleEncode(s->image + s->sent, end - s->sent, s->encoded);
+    s->encsent = 0;
+  }
+  ssize_t n = sessionWrite(s, s->encoded + s->encsent, s->enclen - s->encsent);
+  if (n > 0) {
+    s->encsent += n;
+  }
+  // seriale piena, riprende quando torna scrivibile
+  s->blocked = s->encsent < s->enclen;
+  if (!s->blocked) {
+    s->sent = end;
+    s->enclen = 0;
+  }
+}
+
+// invia i bytes dell'immagine consentiti: una pagina alla volta o fino a window bytes in transito a singolo byte,
+// senza superare i bytes dell'immagine già disponibili
+static void sendImage(at28c_session* s) {
+  if (s->rle) {
+    sendEncodedPage(s);
+    return;
+  }
+  size_t credits;
+  if (s->paged) {
+    // la pagina successiva parte solo dopo la rilettura completa della precedente ed è inviata solo se completa
+    size_t end = s->sent + s->chip->pagesize < s->len ? s->sent + s->chip->pagesize : s->len;
+    if (s->sent != s->done || (s->sent % s->chip->pagesize == 0 && s->available < end)) {
+      return;
+    }
+    credits = s->chip->pagesize;
+  } else {
+    credits = s->window - (s->sent - s->done);
+  }
+  if (credits > s->available - s->sent) {
+    credits = s->available - s->sent;
+  }
+  if (s->paged && s->sent % s->chip->pagesize != 0) {
+    // pagina parzialmente accettata dalla seriale
+    credits = s->chip->pagesize - s->sent % s->chip->pagesize;
+  }
+  s->blocked = false;
+  if (credits == 0) {
+    return;
+  }
+  ssize_t n = sessionWrite(s, s->image + s->sent, credits);
+  if (n > 0) {
+    s->sent += n;
+  }
+  if (n < (ssize_t)credits) {
+    // seriale piena, riprende quando torna scrivibile
+    s->blocked = true;
+  }
+}
+
+// riceve i bytes riletti dal programmatore, nell'ordine di invio (compressi come le pagine inviate)
+static void receiveWriteBytes(at28c_session* s, const unsigned char* buf, size_t len) {
+  for (size_t idx = 0; idx < len && s->done < s->sent; idx++) {
+    unsigned char out[RLE_MAX_RUN];
+    int n = decodeByte(s, buf[idx], out);
+    for (int pos = 0; pos < n && s->done < s->sent; pos++) {
+      if (out[pos] != s->image[s->done]) {
+        notifyMismatch(s, s->done, s->image[s->done], out[pos]);
+      }
+      s->done++;
+    }
+  }
+  notifyProgress(s);
+  if (s->done == s->len) {
+    finish(s, s->errors ? AT28C_MISMATCH : AT28C_OK);
+    return;
+  }
+  // ogni pagina attende al massimo due cicli di scrittura oltre al trasferimento
+  setDeadline(s, STREAM_TIMEOUT_MS + s->chip->writecycle * 2);
+  sendImage(s);
+}
+
+// gestisce una riga di risposta completa
+static void receiveLine(at28c_session* s) {
+  switch (s->state) {
+    case ST_FIRST_VERSION:
+    case ST_VERSION:
+    case ST_PROBE:
+      if (strncmp(s->line, "+VERSION=", 9) != 0) {
+        return;
+      }
+      snprintf(s->version, sizeof(s->version), "%s", s->line + 9);
+      if (s->probes > 1) {
+        // con più richieste in sospeso scarta le risposte successive
+        resync(s, false, AT28C_OK);
+        s->silence = CONNECT_PROBE_MS;
+        setDeadline(s, s->silence);
+      } else {
+        finish(s, AT28C_OK);
+      }
+      return;
+    case ST_ANSWER:
+      if (strncmp(s->line, s->expected, strlen(s->expected)) != 0) {
+        return;
+      }
+      if (s->op == OP_REQUEST) {
+        // raccoglie le righe della risposta fino alla riga finale
+        size_t len = strlen(s->line);
+        if (s->answerlen + len + 2 > sizeof(s->answer)) {
+          finish(s, AT28C_ERROR);
+          return;
+        }
+        if (s->answerlen > 0) {
+          s->answer[s->answerlen++] = '\n';
+        }
+        memcpy(s->answer + s->answerlen, s->line, len + 1);
+        s->answerlen += len;
+        if (s->last[0] == 0 || strcmp(s->line, s->last) == 0) {
+          finish(s, AT28C_OK);
+        }
+        return;
+      }
+      if (s->op == OP_CHIP && strcmp(s->line + strlen(s->expected), "-1") == 0) {
+        finish(s, AT28C_UNSUPPORTED);
+      } else {
+        finish(s, AT28C_OK);
+      }
+      return;
+    case ST_SYNC:
+      if (strcmp(s->line, s->expected) != 0) {
+        return;
+      }
+      if (s->pending == AT28C_BUSY) {
+        requestBlocks(s, true);
+      } else {
+        finish(s, s->pending);
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+// gestisce i bytes ricevuti dal programmatore
+static void receiveBytes(at28c_session* s, const unsigned char* buf, size_t len) {
+  if (s->state == ST_WRITE) {
+    receiveWriteBytes(s, buf, len);
+    return;
+  }
+  if (s->state == ST_DATA) {
+    receiveStreamBytes(s, buf, len);
+    return;
+  }
+  if (s->state == ST_ANSWER) {
+    // le risposte lunghe arrivano man mano che il programmatore le calcola (es. BLOCKSUMS)
+    setDeadline(s, s->wait);
+  }
+  for (size_t idx = 0; idx < len && s->op != OP_NONE; idx++) {
+    unsigned char c = buf[idx];
+    if (s->state == ST_BLOCKS) {
+      receiveBlockByte(s, c);
+      setDeadline(s, ANSWER_TIMEOUT_MS);
+    } else if (s->state == ST_DRAIN) {
+      // scarta i dati residui finché la linea non resta libera, entro un numero di bytes e un tempo massimi
+      if (++s->drained > DRAIN_MAX_BYTES || nowMicros() >= s->drainend) {
+        finish(s, AT28C_ERROR);
+        return;
+      }
+      setDeadline(s, s->silence);
+    } else if (s->state == ST_HEADER) {
+      // l'intestazione è completa quando la linea resta libera, entro il tempo massimo della connessione
+      if (nowMicros() >= s->timeout) {
+        finish(s, AT28C_TIMEOUT);
+        return;
+      }
+      s->header = true;
+      setDeadline(s, VERSION_TIMEOUT_MS);
+    } else if (c == '\r' || c == '\n') {
+      if (s->linelen > 0) {
+        s->line[s->linelen] = 0;
+        s->linelen = 0;
+        e_state state = s->state;
+        receiveLine(s);
+        if (s->state != state) {
+          // i bytes successivi alla risposta (fine riga) precedono il comando appena inviato
+          return;
+        }
+      }
+    } else if (s->linelen < LINE_SIZE - 1) {
+      s->line[s->linelen++] = c;
+    }
+  }
+}
+
+// gestisce la scadenza della fase corrente
+static void expire(at28c_session* s) {
+  long long now = nowMicros();
+  switch (s->state) {
+    case ST_BOOT:
+      // la seriale è pronta: scarta il rumore dell'apertura e chiede la versione
+      tcflush(s->fd, TCIOFLUSH);
+      if (sendCommand(s, "VERSION=?\r") == -1) {
+        finish(s, AT28C_ERROR);
+        return;
+      }
+      s->probes = 1;
+      s->state = ST_FIRST_VERSION;
+      setDeadline(s, VERSION_TIMEOUT_MS);
+      return;
+    case ST_FIRST_VERSION:
+      // programmatore resettato dall'apertura, attende l'intestazione inviata all'avvio
+      s->state = ST_HEADER;
+      s->timeout = now + (HEADER_TIMEOUT_MS + DRAIN_TIMEOUT_MS) * 1000LL;
+      setDeadline(s, HEADER_TIMEOUT_MS);
+      return;
+    case ST_HEADER:
+      if (!s->header) {
+        // nessuna intestazione entro il tempo massimo
+        finish(s, AT28C_TIMEOUT);
+        return;
+      }
+      if (sendCommand(s, "VERSION=?\r") == -1) {
+        finish(s, AT28C_ERROR);
+        return;
+      }
+      s->state = ST_VERSION;
+      setDeadline(s, VERSION_TIMEOUT_MS);
+      return;
+    case ST_PROBE:
+      if (now >= s->timeout) {
+        finish(s, AT28C_TIMEOUT);
+        return;
+      }
+      if (sendCommand(s, "VERSION=?\r") == -1) {
+        finish(s, AT28C_ERROR);
+        return;
+      }
+      s->probes++;
+      setDeadline(s, CONNECT_PROBE_MS);
+      return;
+    case ST_DRAIN:
+      if (s->op == OP_CONNECT) {
+        // risposte alla versione in eccesso scartate, il firmware è già allineato
+        finish(s, s->pending);
+        return;
+      }
+      // il ritorno a capo iniziale svuota eventuali comandi parziali
+      s->token++;
+      char cmd[32];
+      sprintf(cmd, "\rSYNC=%u\r", s->token);
+      sprintf(s->expected, "+SYNC=%u", s->token);
+      s->linelen = 0;
+      if (sendCommand(s, cmd) == -1) {
+        finish(s, AT28C_ERROR);
+        return;
+      }
+      s->state = ST_SYNC;
+      setDeadline(s, ANSWER_TIMEOUT_MS * 2);
+      return;
+    case ST_BLOCKS:
+      // trasferimento interrotto (bytes persi), il firmware ha già terminato l'invio
+      retryBlocks(s, false);
+      return;
+    case ST_DATA:
+      // flusso interrotto (bytes persi), il firmware ha già terminato l'invio
+      resync(s, false, AT28C_TIMEOUT);
+      return;
+    case ST_STREAM:
+      // nessun comando inviato, il programmatore non va riallineato
+      finish(s, AT28C_TIMEOUT);
+      return;
+    case ST_WRITE:
+      // il firmware può essere ancora nella scrittura: riallinea prima di notificare il timeout
+      s->blocked = false;
+      resync(s, false, AT28C_TIMEOUT);
+      return;
+    case ST_VERSION:
+    case ST_ANSWER:
+      finish(s, s->op == OP_CHIP ? AT28C_UNSUPPORTED : AT28C_TIMEOUT);
+      return;
+    case ST_SYNC:
+      finish(s, AT28C_ERROR);
+      return;
+    default:
+      return;
+  }
+}
+
+// memorie conosciute, ritorna NULL se il nome non è presente nella tabella
+const at28c_chip* at28cChip(const char* name) {
+  for (size_t i = 0; i < sizeof(chips) / sizeof(chips[0]); i++) {
+    if (strcmp(chips[i].name, name) == 0) {
+      return &chips[i];
+    }
+  }
+  return NULL;
+}
+
+// CRC16-CCITT dei blocchi verificati del firmware
+unsigned short at28cCrc16(unsigned short crc, const unsigned char* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (unsigned short)data[i] << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// apre e configura la seriale del programmatore (115200 8N1)
+at28c_session* at28cOpen(const char* device, bool keepalive) {
+  int fd = open(device, O_RDWR | O_NOCTTY | O_NDELAY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  // lettura non canonica di almeno un carattere senza timeout
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  tio.c_iflag = IGNBRK;
+  tio.c_lflag = 0;
+  tio.c_oflag = 0;
+  // 8 bit, ricezione abilitata, linee di controllo del modem ignorate, DTR abbassato alla chiusura
+  tio.c_cflag = CS8 | CREAD | HUPCL | CLOCAL;
+  // senza reset il DTR resta attivo alla chiusura, la successiva apertura non resetta il programmatore
+  if (keepalive) {
+    tio.c_cflag &= ~HUPCL;
+  }
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+    close(fd);
+    return NULL;
+  }
+  fcntl(fd, F_SETFL, FNDELAY);
+
+  at28c_session* s = calloc(1, sizeof(at28c_session));
+  if (s == NULL) {
+    close(fd);
+    return NULL;
+  }
+  s->fd = fd;
+  s->keepalive = keepalive;
+  s->chip = at28cChip("AT28C256");
+  s->status = AT28C_OK;
+  s->erroraddr = -1;
+  return s;
+}
+
+// chiude la seriale e libera la sessione
+void at28cClose(at28c_session* session) {
+  if (session != NULL) {
+    close(session->fd);
+    free(session);
+  }
+}
+
+// imposta la registrazione del traffico seriale
+void at28cSetTrace(at28c_session* session, at28c_trace trace, void* user) {
+  session->trace = trace;
+  session->traceuser = user;
+}
+
+// descrittore della seriale
+int at28cFd(const at28c_session* session) {
+  return session->fd;
+}
+
+// eventi poll attesi sulla seriale
+short at28cEvents(const at28c_session* session) {
+  if (session->op == OP_NONE) {
+    return 0;
+  }
+  return POLLIN | (session->blocked ? POLLOUT : 0);
+}
+
+// millisecondi alla prossima scadenza della sessione
+long at28cTimeout(const at28c_session* session) {
+  if (session->op == OP_NONE) {
+    return -1;
+  }
+  long long left = session->deadline - nowMicros();
+  return left > 0 ? (left + 999) / 1000 : 0;
+}
+
+// fa avanzare la sessione con gli eventi poll ricevuti
+int at28cProcess(at28c_session* session, short revents) {
+  at28c_session* s = session;
+  if (s->op == OP_NONE) {
+    return s->status;
+  }
+  if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    finish(s, AT28C_ERROR);
+    return s->status;
+  }
+  if (revents & POLLIN) {
+    unsigned char buf[512];
+    ssize_t n = read(s->fd, buf, sizeof(buf));
+    if (n > 0) {
+      if (s->trace != NULL) {
+        s->trace('<', buf, n, s->traceuser);
+      }
+      receiveBytes(s, buf, n);
+    } else if (n == -1 && errno != EAGAIN && errno != EINTR) {
+      finish(s, AT28C_ERROR);
+      return s->status;
+    }
+  }
+  if ((revents & POLLOUT) && s->state == ST_WRITE) {
+    sendImage(s);
+  }
+  if (s->op != OP_NONE && nowMicros() >= s->deadline) {
+    expire(s);
+  }
+  return s->status;
+}
+
+// attende gli eventi di più sessioni e le fa avanzare
+int at28cPoll(at28c_session** sessions, int count, long msec) {
+  struct pollfd fds[count];
+  long wait = msec;
+  for (int i = 0; i < count; i++) {
+    fds[i].fd = sessions[i]->op != OP_NONE ? sessions[i]->fd : -1;
+    fds[i].events = at28cEvents(sessions[i]);
+    fds[i].revents = 0;
+    long timeout = at28cTimeout(sessions[i]);
+    if (timeout != -1 && (wait == -1 || timeout < wait)) {
+      wait = timeout;
+    }
+  }
+
+  if (poll(fds, count, wait) == -1 && errno != EINTR) {
+    return -1;
+  }
+
+  int busy = 0;
+  for (int i = 0; i < count; i++) {
+    if (sessions[i]->op != OP_NONE && at28cProcess(sessions[i], fds[i].revents) == AT28C_BUSY) {
+      busy++;
+    }
+  }
+  return busy;
+}
+
+// risultato dell'ultima operazione
+int at28cStatus(const at28c_session* session) {
+  return session->status;
+}
+
+// attende il termine dell'operazione in corso
+int at28cWait(at28c_session* session, long msec) {
+  long long end = nowMicros() + msec * 1000LL;
+  while (session->status == AT28C_BUSY) {
+    long wait = -1;
+    if (msec >= 0) {
+      long long left = end - nowMicros();
+      if (left <= 0) {
+        break;
+      }
+      wait = (left + 999) / 1000;
+    }
+    if (at28cPoll(&session, 1, wait) == -1) {
+      return AT28C_ERROR;
+    }
+  }
+  return session->status;
+}
+
+// interrompe l'operazione in corso riallineando il programmatore
+void at28cCancel(at28c_session* session) {
+  at28c_session* s = session;
+  if (s->op == OP_NONE || s->state == ST_DRAIN || s->state == ST_SYNC) {
+    return;
+  }
+  if (s->op == OP_CONNECT || s->state == ST_STREAM) {
+    finish(s, AT28C_CANCELLED);
+    return;
+  }
+  // l'invio dell'immagine si ferma e il firmware interrompe la scrittura allo scadere del timeout di trasferimento,
+  // letture e comandi in esecuzione (es. FILL) vengono interrotti dal carattere di interruzione
+  s->blocked = false;
+  resync(s, s->state != ST_WRITE, AT28C_CANCELLED);
+}
+
+// versione del firmware letta dalla connessione
+const char* at28cVersion(const at28c_session* session) {
+  return session->version;
+}
+
+// memoria selezionata
+const at28c_chip* at28cSelected(const at28c_session* session) {
+  return session->chip;
+}
+
+// bytes diversi dall'immagine dell'ultima scrittura o verifica
+size_t at28cErrors(const at28c_session* session) {
+  return session->errors;
+}
+
+// indirizzo del primo byte diverso dall'immagine
+long at28cErrorAddress(const at28c_session* session) {
+  return session->erroraddr;
+}
+
+// attende il programmatore e ne legge la versione del firmware
+int at28cConnect(at28c_session* session, const at28c_callbacks* callbacks) {
+  at28c_session* s = session;
+  if (begin(s, OP_CONNECT, callbacks) == -1) {
+    return -1;
+  }
+  s->version[0] = 0;
+  s->header = false;
+  s->probes = 0;
+  if (s->keepalive) {
+    // programmatore già avviato: la prima richiesta parte subito
+    s->state = ST_PROBE;
+    s->timeout = nowMicros() + CONNECT_TIMEOUT_MS * 1000LL;
+    s->deadline = 0;
+  } else {
+    s->state = ST_BOOT;
+    setDeadline(s, BOOT_DELAY_MS);
+  }
+  return 0;
+}
+
+// seleziona la memoria sul programmatore
+int at28cSelectChip(at28c_session* session, const at28c_chip* chip, const at28c_callbacks* callbacks) {
+  if (chip == NULL || begin(session, OP_CHIP, callbacks) == -1) {
+    return -1;
+  }
+  session->chip = chip;
+  char cmd[32];
+  sprintf(cmd, "CHIP=%s\r", chip->name);
+  return beginAnswer(session, cmd, "+CHIP=", ANSWER_TIMEOUT_MS);
+}
+
+// avvia una lettura o verifica in blocchi verificati da CRC o con il flusso continuo della memoria
+static int beginRead(at28c_session* s, e_operation op, size_t start, size_t len, at28c_transfer transfer, const at28c_callbacks* callbacks) {
+  if (len == 0 || start + len > s->chip->size || begin(s, op, callbacks) == -1) {
+    return -1;
+  }
+  s->start = start;
+  s->len = len;
+  s->done = 0;
+  s->errors = 0;
+  s->erroraddr = -1;
+  s->rle = transfer == AT28C_STREAM_RLE;
+  if (transfer == AT28C_BLOCKS) {
+    s->retries = READ_RETRIES;
+    requestBlocks(s, false);
+  } else {
+    requestStream(s);
+  }
+  return s->op == OP_NONE ? -1 : 0;
+}
+
+// legge len bytes da start con il trasferimento indicato
+int at28cRead(at28c_session* session, size_t start, size_t len, unsigned char* data, at28c_transfer transfer, const at28c_callbacks* callbacks) {
+  session->data = data;
+  return beginRead(session, OP_READ, start, len, transfer, callbacks);
+}
+
+// verifica len bytes da start con l'immagine
+int at28cVerify(at28c_session* session, size_t start, size_t len, const unsigned char* image, at28c_transfer transfer, const at28c_callbacks* callbacks) {
+  session->image = image;
+  return beginRead(session, OP_VERIFY, start, len, transfer, callbacks);
+}
+
+// bytes dell'immagine necessari all'invio del comando di scrittura: una pagina o una finestra a singolo byte
+static size_t streamStart(const at28c_session* s) {
+  size_t first = s->paged ? (size_t)s->chip->pagesize : (size_t)s->window;
+  return first < s->len ? first : s->len;
+}
+
+// invia il comando di scrittura e i primi bytes dell'immagine
+static void startWrite(at28c_session* s) {
+  // il terzo parametro richiede la sequenza di sblocco SDP prima di ogni byte o pagina,
+  // il quarto il trasferimento compresso RLE delle pagine
+  char cmd[48];
+  if (s->paged) {
+    sprintf(cmd, "WRITEEEPROM=%zu,%d,%d,%d\r", s->len, s->chip->pagesize, s->sdp, s->rle);
+  } else {
+    sprintf(cmd, "WRITEEEPROM=%zu%s\r", s->len, s->sdp ? ",,1" : "");
+  }
+  if (sendCommand(s, cmd) == -1) {
+    finish(s, AT28C_ERROR);
+    return;
+  }
+  s->state = ST_WRITE;
+  setDeadline(s, STREAM_TIMEOUT_MS + s->chip->writecycle * 2);
+  sendImage(s);
+}
+
+// avvia la scrittura dell'intera memoria selezionata con available bytes dell'immagine già disponibili
+static int beginWrite(at28c_session* s, const unsigned char* image, size_t available, bool paged, bool sdp, bool rle, int window, const at28c_callbacks* callbacks) {
+  if ((paged && s->chip->pagesize == 1) || (sdp && !s->chip->sdp) ||
+      (rle && (!paged || s->chip->pagesize > RLE_PAGE_MAX)) || begin(s, OP_WRITE, callbacks) == -1) {
+    return -1;
+  }
+  s->image = image;
+  s->start = 0;
+  s->len = s->chip->size;
+  s->available = available;
+  s->sent = 0;
+  s->done = 0;
+  s->paged = paged;
+  s->sdp = sdp;
+  s->window = window > 1 && !paged ? window : 1;
+  s->rle = rle;
+  s->enclen = 0;
+  s->errors = 0;
+  s->erroraddr = -1;
+
+  // il programmatore abbandona la scrittura se i bytes non arrivano entro il timeout di trasferimento:
+  // il comando parte solo con la prima pagina o finestra disponibile
+  if (s->available < streamStart(s)) {
+    s->state = ST_STREAM;
+    setDeadline(s, STREAM_START_TIMEOUT_MS);
+    return 0;
+  }
+  startWrite(s);
+  return s->op == OP_NONE ? -1 : 0;
+}
+
+// scrive l'intera memoria selezionata
+int at28cWrite(at28c_session* session, const unsigned char* image, bool paged, bool sdp, bool rle, int window, const at28c_callbacks* callbacks) {
+  return beginWrite(session, image, session->chip->size, paged, sdp, rle, window, callbacks);
+}
+
+// scrive l'intera memoria selezionata man mano che l'immagine viene resa disponibile
+int at28cWriteStream(at28c_session* session, const unsigned char* image, bool paged, bool sdp, int window, const at28c_callbacks* callbacks) {
+  return beginWrite(session, image, 0, paged, sdp, false, window, callbacks);
+}
+
+// estende i bytes disponibili dell'immagine della scrittura in corso
+int at28cWriteAvailable(at28c_session* session, size_t available) {
+  at28c_session* s = session;
+  if (s->op != OP_WRITE || available < s->available || available > s->len) {
+    return -1;
+  }
+  s->available = available;
+  if (s->state == ST_STREAM && available >= streamStart(s)) {
+    startWrite(s);
+  } else if (s->state == ST_WRITE && !s->blocked) {
+    size_t sent = s->sent;
+    sendImage(s);
+    // il programmatore attende i bytes successivi solo per il timeout di trasferimento
+    if (s->sent != sent) {
+      setDeadline(s, STREAM_TIMEOUT_MS + s->chip->writecycle * 2);
+    }
+  }
+  return 0;
+}
+
+// abilita o disabilita il software data protection
+int at28cSetSDP(at28c_session* session, bool enable, const at28c_callbacks* callbacks) {
+  if (begin(session, OP_SDP, callbacks) == -1) {
+    return -1;
+  }
+  return beginAnswer(session, enable ? "ENABLESDP=1\r" : "ENABLESDP=0\r", "+ENABLESDP=", ANSWER_TIMEOUT_MS);
+}
+
+// invia un comando e attende le righe di risposta con il prefisso indicato
+int at28cRequest(at28c_session* session, const char* cmd, const char* expected, const char* last, long msec, const at28c_callbacks* callbacks) {
+  if (strlen(expected) >= sizeof(session->expected) || (last != NULL && strlen(last) >= sizeof(session->last)) ||
+      begin(session, OP_REQUEST, callbacks) == -1) {
+    return -1;
+  }
+  snprintf(session->last, sizeof(session->last), "%s", last != NULL ? last : "");
+  session->answer[0] = 0;
+  session->answerlen = 0;
+  return beginAnswer(session, cmd, expected, msec);
+}
+
+// righe complete dell'ultima risposta di at28cRequest
+const char* at28cAnswer(const at28c_session* session) {
+  return session->answer;
+}
+
+// riallinea il programmatore
+int at28cSync(at28c_session* session, bool abort, const at28c_callbacks* callbacks) {
+  if (begin(session, OP_SYNC, callbacks) == -1) {
+    return -1;
+  }
+  resync(session, abort, AT28C_OK);
+  return 0;
+}
@@ -0,0 +1,176 @@
+// libreria di comunicazione con il programmatore AT28C, API non bloccante
+//
+// ogni programmatore è una sessione con la propria seriale, una sessione esegue una operazione alla volta:
+// le funzioni at28cConnect, at28cSelectChip, at28cRead, at28cVerify, at28cWrite, at28cWriteStream, at28cSetSDP,
+// at28cRequest e at28cSync avviano l'operazione e ritornano subito (0 se avviata, -1 se un'altra operazione è in
+// corso o i parametri non sono validi), il termine viene notificato dal callback done oppure letto con at28cStatus (AT28C_BUSY finché
+// l'operazione è in corso) o atteso con at28cWait
+//
+// le sessioni avanzano solo all'interno di at28cPoll (più sessioni con un'unica attesa) o di at28cProcess,
+// da chiamare con gli eventi di at28cFd quando la sessione è integrata in un ciclo di eventi esterno
+// (at28cEvents indica gli eventi attesi e at28cTimeout la prossima scadenza)
+//
+// i buffer dei dati sono forniti dal chiamante e devono restare validi fino al termine dell'operazione:
+// le letture scrivono direttamente nel buffer, scritture e verifiche leggono direttamente dall'immagine
+
+#ifndef AT28CLIB_H
+#define AT28CLIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// stato e risultato delle operazioni
+#define AT28C_OK 0
+// operazione in corso
+#define AT28C_BUSY 1
+// errore di comunicazione o risposta non valida
+#define AT28C_ERROR -1
+// nessuna risposta entro il tempo massimo
+#define AT28C_TIMEOUT -2
+// bytes riletti diversi dall'immagine (scrittura e verifica)
+#define AT28C_MISMATCH -3
+// operazione interrotta da at28cCancel
+#define AT28C_CANCELLED -4
+// comando non supportato dal firmware
+#define AT28C_UNSUPPORTED -5
+
+typedef struct at28c_session at28c_session;
+
+// trasferimento delle letture e delle verifiche
+typedef enum {
+  // blocchi verificati da CRC, i blocchi corrotti vengono richiesti nuovamente
+  AT28C_BLOCKS,
+  // flusso continuo della memoria dall'indirizzo 0, senza verifica
+  AT28C_STREAM,
+  // flusso continuo compresso RLE (firmware che rispondono +RLE=1)
+  AT28C_STREAM_RLE
+} at28c_transfer;
+
+// parametri di una memoria della tabella Chips.h
+typedef struct {
+  const char* name;
+  size_t size;
+  int pagesize;
+  bool sdp;
+  int writecycle;
+} at28c_chip;
+
+// notifiche di una operazione, tutti i campi sono opzionali
+typedef struct {
+  // avanzamento del trasferimento in bytes
+  void (*progress)(at28c_session* session, size_t done, size_t total, void* user);
+  // byte riletto diverso dall'immagine (scrittura e verifica)
+  void (*mismatch)(at28c_session* session, size_t address, unsigned char expected, unsigned char actual, void* user);
+  // termine dell'operazione con il risultato
+  void (*done)(at28c_session* session, int result, void* user);
+  void* user;
+} at28c_callbacks;
+
+// registrazione del traffico seriale, direzione '>' verso il programmatore e '<' dal programmatore
+typedef void (*at28c_trace)(char direction, const void* buf, size_t len, void* user);
+
+// memorie conosciute, ritorna NULL se il nome non è presente nella tabella
+const at28c_chip* at28cChip(const char* name);
+
+// CRC16-CCITT dei blocchi verificati del firmware
+unsigned short at28cCrc16(unsigned short crc, const unsigned char* data, size_t len);
+
+// apre e configura la seriale del programmatore (115200 8N1), con keepalive il programmatore non viene resettato
+// all'apertura né alla chiusura, ritorna NULL in caso di errore
+at28c_session* at28cOpen(const char* device, bool keepalive);
+
+// chiude la seriale e libera la sessione (un'operazione in corso viene abbandonata senza notifica)
+void at28cClose(at28c_session* session);
+
+// imposta la registrazione del traffico seriale
+void at28cSetTrace(at28c_session* session, at28c_trace trace, void* user);
+
+// descrittore della seriale, per i trasferimenti specifici di un comando (es. SCAN) a sessione inattiva
+int at28cFd(const at28c_session* session);
+
+// eventi poll attesi sulla seriale, 0 se la sessione è inattiva
+short at28cEvents(const at28c_session* session);
+
+// millisecondi alla prossima scadenza della sessione, -1 se inattiva
+long at28cTimeout(const at28c_session* session);
+
+// fa avanzare la sessione con gli eventi poll ricevuti (anche 0 allo scadere del timeout), ritorna at28cStatus
+int at28cProcess(at28c_session* session, short revents);
+
+// attende fino a msec millisecondi (-1 senza limite) gli eventi di più sessioni e le fa avanzare,
+// ritorna il numero di sessioni ancora in corso, -1 in caso di errore
+int at28cPoll(at28c_session** sessions, int count, long msec);
+
+// risultato dell'ultima operazione, AT28C_BUSY se in corso
+int at28cStatus(const at28c_session* session);
+
+// attende il termine dell'operazione in corso per al massimo msec millisecondi (-1 senza limite), ritorna at28cStatus
+int at28cWait(at28c_session* session, long msec);
+
+// interrompe l'operazione in corso riallineando il programmatore, termina con AT28C_CANCELLED
+void at28cCancel(at28c_session* session);
+
+// versione del firmware letta dalla connessione
+const char* at28cVersion(const at28c_session* session);
+
+// memoria selezionata (predefinita AT28C256, come il firmware all'avvio)
+const at28c_chip* at28cSelected(const at28c_session* session);
+
+// bytes diversi dall'immagine e indirizzo del primo dell'ultima scrittura o verifica (-1 se nessuno)
+size_t at28cErrors(const at28c_session* session);
+long at28cErrorAddress(const at28c_session* session);
+
+// attende il programmatore e ne legge la versione del firmware
+int at28cConnect(at28c_session* session, const at28c_callbacks* callbacks);
+
+// seleziona la memoria sul programmatore, AT28C_UNSUPPORTED con i firmware precedenti (la memoria resta
+// comunque selezionata nella sessione)
+int at28cSelectChip(at28c_session* session, const at28c_chip* chip, const at28c_callbacks* callbacks);
+
+// legge len bytes da start con il trasferimento indicato, i flussi continui partono dall'indirizzo 0 e i bytes
+// precedenti a start vengono scartati
+int at28cRead(at28c_session* session, size_t start, size_t len, unsigned char* data, at28c_transfer transfer, const at28c_callbacks* callbacks);
+
+// verifica len bytes da start con l'immagine (image[0] corrisponde a start) con il trasferimento indicato
+int at28cVerify(at28c_session* session, size_t start, size_t len, const unsigned char* image, at28c_transfer transfer, const at28c_callbacks* callbacks);
+
+// scrive l'intera memoria selezionata, a pagine o a byte con window bytes in transito, con sdp ogni pagina o byte
+// viene preceduto dalla sequenza di sblocco, con rle le pagine e la loro rilettura sono compresse (solo a pagine),
+// ogni byte riletto dal programmatore viene confrontato con l'immagine
+int at28cWrite(at28c_session* session, const unsigned char* image, bool paged, bool sdp, bool rle, int window, const at28c_callbacks* callbacks);
+
+// come at28cWrite con l'immagine prodotta durante la scrittura (es. da una pipe): vengono inviati solo i bytes resi
+// disponibili con at28cWriteAvailable, a pagine complete nella scrittura paginata; il comando di scrittura parte
+// con la prima pagina o finestra disponibile (AT28C_TIMEOUT se non arriva entro 60 s), poi il programmatore
+// interrompe la scrittura, lasciando la memoria scritta in parte, se i bytes successivi non arrivano entro
+// il timeout di trasferimento (100 ms)
+int at28cWriteStream(at28c_session* session, const unsigned char* image, bool paged, bool sdp, int window, const at28c_callbacks* callbacks);
+
+// estende i bytes dell'immagine disponibili dall'inizio, ritorna -1 se non è in corso una scrittura o available
+// non è valido
+int at28cWriteAvailable(at28c_session* session, size_t available);
+
+// abilita o disabilita il software data protection
+int at28cSetSDP(at28c_session* session, bool enable, const at28c_callbacks* callbacks);
+
+// invia un comando (terminato da \r) e attende la riga di risposta che inizia con expected, ignorando le altre;
+// con last diverso da NULL raccoglie le righe con il prefisso fino alla riga last compresa. La risposta termina
+// con AT28C_TIMEOUT se il programmatore non invia bytes per msec millisecondi
+int at28cRequest(at28c_session* session, const char* cmd, const char* expected, const char* last, long msec, const at28c_callbacks* callbacks);
+
+// righe complete dell'ultima risposta di at28cRequest, separate da \n
+const char* at28cAnswer(const at28c_session* session);
+
+// riallinea il programmatore dopo un trasferimento interrotto o una risposta non attesa, con abort viene prima
+// inviato il carattere di interruzione dei trasferimenti verso l'host
+int at28cSync(at28c_session* session, bool abort, const at28c_callbacks* callbacks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,514 @@
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// libreria verificata
+#include "AT28CLib.h"
+
+// blocchi dei trasferimenti verificati da CRC del firmware
+#define SIM_BLOCK_SIZE 256
+
+// timeout del firmware tra due bytes di un trasferimento dati (ms)
+#define SIM_STREAM_TIMEOUT_MS 100
+
+// attesa massima di ogni operazione della libreria (ms)
+#define TEST_TIMEOUT_MS 10000
+
+// comportamento del programmatore simulato: blocchi corrotti (indirizzo e numero di invii corrotti),
+// bytes di scrittura dopo i quali il ciclo di scrittura si blocca per stall ms
+typedef struct {
+  int corruptaddr[4];
+  int corruptcount[4];
+  int stallafter;
+  int stall;
+} sim_config;
+
+// programmatore simulato su pseudo terminale e sessione della libreria collegata
+typedef struct {
+  pid_t pid;
+  at28c_session* session;
+} sim_link;
+
+// contenuto iniziale della memoria simulata
+static unsigned char simByte(size_t address) {
+  return (unsigned char)(address * 7 + (address >> 8));
+}
+
+// legge len bytes dal lato programmatore attendendo ogni byte per max msec millisecondi, ritorna i bytes letti
+static size_t simRead(int fd, unsigned char* buf, size_t len, int msec) {
+  size_t received = 0;
+  while (received < len) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, msec) <= 0) {
+      break;
+    }
+    ssize_t n = read(fd, buf + received, len - received);
+    if (n <= 0) {
+      break;
+    }
+    received += n;
+  }
+  return received;
+}
+
+// invia una riga di risposta
+static void simLine(int fd, const char* line) {
+  if (write(fd, line, strlen(line)) == -1 || write(fd, "\r\n", 2) == -1) {
+    _exit(1);
+  }
+}
+
+// comprime un buffer in formato RLE (byte di controllo 0..127 letterali, 0x80 | n - 2 ripetizioni), ritorna i bytes
+// prodotti in dst, con spazio per almeno len + len / 128 + 1 bytes
+static size_t simEncode(const unsigned char* src, size_t len, unsigned char* dst) {
+  size_t out = 0;
+  size_t idx = 0;
+  while (idx < len) {
+    size_t run = 1;
+    while (idx + run < len && src[idx + run] == src[idx] && run < 129) {
+      run++;
+    }
+    if (run >= 3) {
+      dst[out++] = 0x80 | (run - 2);
+      dst[out++] = src[idx];
+      idx += run;
+      continue;
+    }
+    // letterali fino alla prossima ripetizione di almeno 3 bytes
+    size_t literal = 0;
+    while (idx + literal < len && literal < 128 &&
+           !(idx + literal + 2 < len && src[idx + literal] == src[idx + literal + 1] && src[idx + literal] == src[idx + literal + 2])) {
+      literal++;
+    }
+    dst[out++] = literal - 1;
+    memcpy(dst + out, src + idx, literal);
+    out += literal;
+    idx += literal;
+  }
+  return out;
+}
+
+// riceve len bytes compressi RLE attendendo ogni byte per max msec millisecondi, ritorna i bytes decodificati
+static size_t simReadEncoded(int fd, unsigned char* buf, size_t len, int msec) {
+  size_t done = 0;
+  while (done < len) {
+    unsigned char control, value;
+    if (simRead(fd, &control, 1, msec) != 1) {
+      break;
+    }
+    if (control & 0x80) {
+      size_t run = (control & 0x7F) + 2;
+      if (done + run > len || simRead(fd, &value, 1, msec) != 1) {
+        break;
+      }
+      memset(buf + done, value, run);
+      done += run;
+    } else {
+      size_t literal = control + 1;
+      if (done + literal > len || simRead(fd, buf + done, literal, msec) != literal) {
+        break;
+      }
+      done += literal;
+    }
+  }
+  return done;
+}
+
+// invia len bytes, compressi RLE se richiesto
+static void simSend(int fd, const unsigned char* buf, size_t len, bool rle) {
+  unsigned char encoded[SIM_BLOCK_SIZE + SIM_BLOCK_SIZE / 128 + 1];
+  if (rle) {
+    len = simEncode(buf, len, encoded);
+    buf = encoded;
+  }
+  if (write(fd, buf, len) == -1) {
+    _exit(1);
+  }
+}
+
+// READEEPROM: flusso di len bytes da 0, compresso RLE se richiesto, interrotto dal carattere di interruzione dell'host
+static void simStream(int fd, unsigned char* mem, size_t len, bool rle) {
+  for (size_t addr = 0; addr < len; addr += SIM_BLOCK_SIZE) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 0) > 0) {
+      return;
+    }
+    simSend(fd, mem + addr, len - addr < SIM_BLOCK_SIZE ? len - addr : SIM_BLOCK_SIZE, rle);
+  }
+}
+
+// READBLOCKS: blocchi con indirizzo, dati e CRC, interrotti dal carattere di interruzione dell'host
+static void simBlocks(int fd, sim_config* config, unsigned char* mem, size_t start, size_t len, size_t bs) {
+  unsigned char frame[SIM_BLOCK_SIZE + 4];
+  for (size_t addr = start; addr < start + len; addr += bs) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 0) > 0) {
+      return;
+    }
+    size_t n = start + len - addr < bs ? start + len - addr : bs;
+    frame[0] = (addr >> 8) & 0xFF;
+    frame[1] = addr & 0xFF;
+    memcpy(frame + 2, mem + addr, n);
+    unsigned short crc = at28cCrc16(0xFFFF, frame, n + 2);
+    frame[n + 2] = crc >> 8;
+    frame[n + 3] = crc & 0xFF;
+    for (int i = 0; i < 4; i++) {
+      if (config->corruptcount[i] > 0 && (size_t)config->corruptaddr[i] == addr) {
+        config->corruptcount[i]--;
+        frame[2] ^= 0x55;
+      }
+    }
+    if (write(fd, frame, n + 4) == -1) {
+      _exit(1);
+    }
+  }
+}
+
+// WRITEEEPROM: riceve a pagine (compresse RLE se richiesto) o a byte e rimanda i bytes scritti, abbandona allo
+// scadere del timeout di trasferimento
+static void simWrite(int fd, sim_config* config, unsigned char* mem, size_t size, int pagesize, bool rle) {
+  unsigned char page[256];
+  for (size_t addr = 0; addr < size; addr += pagesize) {
+    size_t n = rle ? simReadEncoded(fd, page, pagesize, SIM_STREAM_TIMEOUT_MS) : simRead(fd, page, pagesize, SIM_STREAM_TIMEOUT_MS);
+    if (n != (size_t)pagesize) {
+      return;
+    }
+    if (config->stallafter > 0 && addr + pagesize > (size_t)config->stallafter) {
+      // ciclo di scrittura bloccato, il programmatore resta nel motore di scrittura
+      config->stallafter = 0;
+      usleep(config->stall * 1000);
+    }
+    memcpy(mem + addr, page, pagesize);
+    simSend(fd, page, pagesize, rle);
+  }
+}
+
+// ciclo dei comandi del programmatore simulato, termina alla chiusura della seriale da parte dell'host
+static void simRun(int fd, sim_config* config) {
+  static unsigned char mem[32768];
+  for (size_t i = 0; i < sizeof(mem); i++) {
+    mem[i] = simByte(i);
+  }
+
+  char line[128];
+  size_t linelen = 0;
+  while (true) {
+    unsigned char c;
+    ssize_t n = read(fd, &c, 1);
+    if (n == -1 && (errno == EINTR || errno == EAGAIN)) {
+      continue;
+    } else if (n <= 0) {
+      _exit(0);
+    }
+    if (c != '\r' && c != '\n') {
+      if (linelen < sizeof(line) - 1) {
+        line[linelen++] = c;
+      }
+      continue;
+    }
+    line[linelen] = 0;
+    linelen = 0;
+
+    char reply[128];
+    size_t a, b, d;
+    int e, f;
+    if (strcmp(line, "VERSION=?") == 0) {
+      simLine(fd, "+VERSION=0.008");
+    } else if (strncmp(line, "CHIP=", 5) == 0) {
+      snprintf(reply, sizeof(reply), "+CHIP=%s", line + 5);
+      simLine(fd, reply);
+    } else if (strncmp(line, "SYNC=", 5) == 0) {
+      snprintf(reply, sizeof(reply), "+SYNC=%s", line + 5);
+      simLine(fd, reply);
+    } else if (strcmp(line, "DIAG=?") == 0) {
+      // righe di altri comandi in mezzo alla risposta vengono ignorate
+      simLine(fd, "+DIAG=UPTIME,1500");
+      simLine(fd, "+RLE=1");
+      simLine(fd, "+DIAG=LOOP,10,20");
+      simLine(fd, "+DIAG=END");
+    } else if (sscanf(line, "READEEPROM=%zu,%d", &a, &e) == 2 && a <= sizeof(mem)) {
+      simStream(fd, mem, a, e == 1);
+    } else if (sscanf(line, "READEEPROM=%zu", &a) == 1 && a <= sizeof(mem)) {
+      simStream(fd, mem, a, false);
+    } else if (sscanf(line, "READBLOCKS=%zu,%zu,%zu", &a, &b, &d) == 3 && a + b <= sizeof(mem) && d <= SIM_BLOCK_SIZE) {
+      simBlocks(fd, config, mem, a, b, d);
+    } else if (sscanf(line, "WRITEEEPROM=%zu,%zu,%d,%d", &a, &b, &e, &f) == 4 && a <= sizeof(mem) && b <= 256) {
+      simWrite(fd, config, mem, a, b, f == 1);
+    } else if (sscanf(line, "WRITEEEPROM=%zu,%zu,%d", &a, &b, &e) == 3 && a <= sizeof(mem) && b <= 256) {
+      simWrite(fd, config, mem, a, b, false);
+    } else if (sscanf(line, "WRITEEEPROM=%zu", &a) == 1 && a <= sizeof(mem)) {
+      simWrite(fd, config, mem, a, 1, false);
+    }
+  }
+}
+
+// avvia il programmatore simulato e collega una sessione connessa con la memoria AT28C256 selezionata
+static int simStart(sim_link* link, sim_config config) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    printf("error opening pseudo terminal\n");
+    return -1;
+  }
+  char* slavename = ptsname(master);
+  // mantiene aperto il lato slave fino all'apertura della sessione, altrimenti il master segnala la chiusura
+  int slave = open(slavename, O_RDWR | O_NOCTTY);
+  if (slave == -1) {
+    close(master);
+    return -1;
+  }
+
+  link->pid = fork();
+  if (link->pid == -1) {
+    close(slave);
+    close(master);
+    return -1;
+  }
+  if (link->pid == 0) {
+    close(slave);
+    simRun(master, &config);
+  }
+  close(master);
+
+  link->session = at28cOpen(slavename, true);
+  close(slave);
+  if (link->session == NULL) {
+    return -1;
+  }
+  if (at28cConnect(link->session, NULL) == -1 || at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK ||
+      at28cSelectChip(link->session, at28cChip("AT28C256"), NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK) {
+    return -1;
+  }
+  return 0;
+}
+
+// chiude la sessione e attende il termine del programmatore simulato
+static void simStop(sim_link* link) {
+  if (link->session != NULL) {
+    at28cClose(link->session);
+  }
+  waitpid(link->pid, NULL, 0);
+}
+
+// richieste READBLOCKS inviate al programmatore: totali, ripetizioni di un solo blocco e richieste non valide
+typedef struct {
+  int total;
+  int single;
+  int wrong;
+} request_count;
+
+// conta le richieste di blocchi verificati, ogni richiesta è di un solo blocco o fino alla fine della memoria
+static void onTrace(char direction, const void* buf, size_t len, void* user) {
+  request_count* count = user;
+  char cmd[64];
+  size_t start, n;
+  if (direction != '>' || len >= sizeof(cmd)) {
+    return;
+  }
+  memcpy(cmd, buf, len);
+  cmd[len] = 0;
+  if (sscanf(cmd, "READBLOCKS=%zu,%zu", &start, &n) != 2) {
+    return;
+  }
+  count->total++;
+  if (start != 0) {
+    if (n == SIM_BLOCK_SIZE) {
+      count->single++;
+    } else if (start + n != 32768) {
+      count->wrong++;
+    }
+  }
+}
+
+// interrompe l'operazione dopo i primi bytes completati
+static void onProgress(at28c_session* session, size_t done, size_t total, void* user) {
+  (void)total;
+  (void)user;
+  if (done >= 4096) {
+    at28cCancel(session);
+  }
+}
+
+// verifica che len bytes da start corrispondano al contenuto iniziale della memoria simulata
+static bool checkData(const unsigned char* data, size_t start, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] != simByte(start + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// lettura con blocchi corrotti: ogni blocco ha i propri tentativi e viene richiesto di nuovo da solo
+static bool testReadRetry(sim_link* link) {
+  static unsigned char data[32768];
+  request_count count = { 0, 0, 0 };
+  at28cSetTrace(link->session, onTrace, &count);
+  if (at28cRead(link->session, 0, sizeof(data), data, AT28C_BLOCKS, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK || !checkData(data, 0, sizeof(data))) {
+    return false;
+  }
+  // almeno le 3 ripetizioni del primo blocco corrotto e una del secondo
+  return count.single >= 4 && count.wrong == 0;
+}
+
+// lettura con un blocco sempre corrotto: abbandonata esauriti i tentativi del blocco
+static bool testReadFail(sim_link* link) {
+  static unsigned char data[32768];
+  return at28cRead(link->session, 0, sizeof(data), data, AT28C_BLOCKS, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_ERROR;
+}
+
+// lettura interrotta: il programmatore viene riallineato e la sessione resta utilizzabile
+static bool testCancel(sim_link* link) {
+  static unsigned char data[32768];
+  at28c_callbacks callbacks = { onProgress, NULL, NULL, NULL };
+  if (at28cRead(link->session, 0, sizeof(data), data, AT28C_BLOCKS, &callbacks) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_CANCELLED) {
+    return false;
+  }
+  memset(data, 0, sizeof(data));
+  return at28cRead(link->session, 0x1000, 1024, data, AT28C_BLOCKS, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK && checkData(data, 0x1000, 1024);
+}
+
+// scrittura a pagine e a byte con verifica finale
+static bool testWrite(sim_link* link) {
+  static unsigned char image[32768];
+  for (size_t i = 0; i < sizeof(image); i++) {
+    image[i] = (unsigned char)rand();
+  }
+  if (at28cWrite(link->session, image, true, false, false, 1, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK ||
+      at28cVerify(link->session, 0, sizeof(image), image, AT28C_BLOCKS, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(image); i++) {
+    image[i] = ~image[i];
+  }
+  return at28cWrite(link->session, image, false, false, false, 32, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK &&
+         at28cVerify(link->session, 0, sizeof(image), image, AT28C_BLOCKS, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK;
+}
+
+// scrittura da flusso: il comando attende la prima pagina, oltre il timeout di trasferimento del programmatore
+static bool testWriteStream(sim_link* link) {
+  static unsigned char image[32768];
+  for (size_t i = 0; i < sizeof(image); i++) {
+    image[i] = (unsigned char)(i >> 3);
+  }
+  if (at28cWriteStream(link->session, image, true, false, 1, NULL) == -1 ||
+      at28cWait(link->session, SIM_STREAM_TIMEOUT_MS * 3) != AT28C_BUSY) {
+    return false;
+  }
+  // immagine resa disponibile a blocchi di dimensione diversa dalla pagina
+  for (size_t available = 1000; available < sizeof(image); available += 1000) {
+    if (at28cWriteAvailable(link->session, available) == -1 || at28cWait(link->session, 5) < AT28C_OK) {
+      return false;
+    }
+  }
+  return at28cWriteAvailable(link->session, sizeof(image)) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK &&
+         at28cVerify(link->session, 0, sizeof(image), image, AT28C_BLOCKS, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK;
+}
+
+// scrittura con il programmatore bloccato: timeout notificato dopo il riallineamento, la sessione resta utilizzabile
+static bool testWriteTimeout(sim_link* link) {
+  static unsigned char image[32768];
+  memset(image, 0xA5, sizeof(image));
+  if (at28cWrite(link->session, image, true, false, false, 1, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_TIMEOUT) {
+    return false;
+  }
+  // la lettura successiva non trova residui della scrittura e non viene ripetuta
+  unsigned char data[1024];
+  request_count count = { 0, 0, 0 };
+  at28cSetTrace(link->session, onTrace, &count);
+  return at28cRead(link->session, 0, sizeof(data), data, AT28C_BLOCKS, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK && data[0] == 0xA5 && count.total == 1;
+}
+
+// scrittura a pagine compresse RLE, rilettura e verifica con i flussi semplice e compresso
+static bool testRle(sim_link* link) {
+  static unsigned char image[32768];
+  static unsigned char data[32768];
+  // ripetizioni lunghe e letterali alternati
+  for (size_t i = 0; i < sizeof(image); i++) {
+    image[i] = (i / 300) % 2 ? (unsigned char)(i >> 10) : (unsigned char)rand();
+  }
+  if (at28cWrite(link->session, image, true, false, true, 1, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK ||
+      at28cVerify(link->session, 0, sizeof(image), image, AT28C_STREAM_RLE, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK ||
+      at28cRead(link->session, 0x1234, 0x2000, data, AT28C_STREAM, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK || memcmp(data, image + 0x1234, 0x2000) != 0) {
+    return false;
+  }
+  // la scrittura compressa è solo a pagine
+  if (at28cWrite(link->session, image, false, false, true, 1, NULL) != -1) {
+    return false;
+  }
+  image[0x4321] ^= 0xFF;
+  return at28cVerify(link->session, 0, sizeof(image), image, AT28C_STREAM_RLE, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_MISMATCH && at28cErrors(link->session) == 1;
+}
+
+// risposta di più righe e riallineamento, la sessione resta utilizzabile
+static bool testRequest(sim_link* link) {
+  if (at28cRequest(link->session, "DIAG=?\r", "+DIAG=", "+DIAG=END", 1000, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_OK ||
+      strcmp(at28cAnswer(link->session), "+DIAG=UPTIME,1500\n+DIAG=LOOP,10,20\n+DIAG=END") != 0) {
+    return false;
+  }
+  // comando senza risposta
+  if (at28cRequest(link->session, "NONE=?\r", "+NONE=", NULL, 200, NULL) == -1 ||
+      at28cWait(link->session, TEST_TIMEOUT_MS) != AT28C_TIMEOUT) {
+    return false;
+  }
+  unsigned char data[1024];
+  // senza last la risposta è la prima riga con il prefisso
+  return at28cSync(link->session, true, NULL) == 0 && at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK &&
+         at28cRead(link->session, 0, sizeof(data), data, AT28C_BLOCKS, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK && checkData(data, 0, sizeof(data)) &&
+         at28cRequest(link->session, "DIAG=?\r", "+DIAG=", NULL, 1000, NULL) == 0 &&
+         at28cWait(link->session, TEST_TIMEOUT_MS) == AT28C_OK &&
+         strcmp(at28cAnswer(link->session), "+DIAG=UPTIME,1500") == 0;
+}
+
+// esegue una prova con un nuovo programmatore simulato
+static bool runTest(const char* name, bool (*test)(sim_link*), sim_config config) {
+  sim_link link = { 0, NULL };
+  bool pass = simStart(&link, config) == 0 && test(&link);
+  simStop(&link);
+  printf("%s: %s\n", name, pass ? "PASS" : "FAIL");
+  return pass;
+}
+
+int main (int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  int failed = 0;
+  sim_config retry = { { 0x1000, 0x7F00 }, { 3, 2 }, 0, 0 };
+  failed += !runTest("read with CRC retries", testReadRetry, retry);
+  sim_config fail = { { 0x2000 }, { 4 }, 0, 0 };
+  failed += !runTest("read retries exhausted", testReadFail, fail);
+  sim_config plain = { { 0 }, { 0 }, 0, 0 };
+  failed += !runTest("read cancel", testCancel, plain);
+  failed += !runTest("write", testWrite, plain);
+  failed += !runTest("write stream", testWriteStream, plain);
+  sim_config stall = { { 0 }, { 0 }, 4096, 150 };
+  failed += !runTest("write timeout", testWriteTimeout, stall);
+  failed += !runTest("rle write and stream read", testRle, plain);
+  failed += !runTest("request and sync", testRequest, plain);
+  return failed ? 1 : 0;
+}
@@ -1,52 +1,342 @@
 ﻿#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/select.h>
+#include <poll.h>
+
+// tabella delle memorie supportate, condivisa con il firmware
+#include "Chips.h"
+
+// formato dei file di traccia del traffico seriale
+#include "AT28CTrace.h"
+
+// protocollo e sessioni del programmatore
+#include "AT28CLib.h"
 
 // tipologie memorie conosciute
+#define ROM_TYPE(NAME, SIZE, PAGE, SDP, TWC) NAME,
 typedef enum {
-  AT28C64,
-  AT28C256,
+  AT28C_CHIPS(ROM_TYPE)
   NONE
 } e_rom_type;
 
+// parametri delle memorie conosciute, nell'ordine di e_rom_type
+typedef struct {
+  const char* name;
+  size_t size;
+  int pagesize;
+  bool sdp;
+  int writecycle;
+} rom_descriptor;
+
+#define ROM_DESCRIPTOR(NAME, SIZE, PAGE, SDP, TWC) { #NAME, SIZE, PAGE, SDP, TWC },
+const rom_descriptor romtypes[] = {
+  AT28C_CHIPS(ROM_DESCRIPTOR)
+};
+
+// bytes dell'immagine letta da standard input accumulati prima di avviare la scrittura: margine per le pause
+// del produttore, che deve poi tenere il passo della scrittura
+#define STREAM_LEAD_BYTES 4096
+
+// bytes per blocco misurato dalla scansione dei cicli di scrittura nelle memorie senza scrittura paginata
+#define SCAN_BLOCK_SIZE 64
+// durata riportata dal programmatore per un ciclo di scrittura non terminato
+#define SCAN_TIMEOUT_US 0xFFFF
+// tempo di bus massimo per byte della programmazione con schema (us): lettura preventiva, scrittura e verifica
+// eseguite dal firmware con digitalRead/digitalWrite, esclusa l'attesa del ciclo di scrittura
+#define FILL_BYTE_US 500
+// file di recupero del contenuto originale se un blocco della scansione interrotta non può essere ripristinato
+#define SCAN_BACKUP_FILENAME "AT28C-scan-backup.bin"
+// bytes dell'area di prova della ricerca delle temporizzazioni (TUNE_BYTES del firmware)
+#define TUNE_SCRATCH_BYTES 16
+// blocchi per riga della mappa dei cicli di scrittura
+#define SCAN_MAP_COLUMNS 32
+// simboli della mappa per durate crescenti fino alla soglia
+#define SCAN_MAP_LEVELS ".:-=+*#"
+
+// vista su un file immagine mappato in memoria: il byte i della vista è il byte offset + i * stride del file,
+// oltre la lunghezza della vista o la fine del file vale fill (-1 = immagine troppo corta).
+// Una vista può descrivere un set di memorie (setsize > 1, es. byte pari e dispari su due memorie)
+typedef struct {
+  size_t offset;
+  size_t stride;
+  size_t length;
+  int fill;
+  int setsize;
+} image_view;
+
+// bytes dell'immagine confrontati per il rilevamento del cambio memoria
+#define SWAP_SIGNATURE_BYTES 4
+// letture uguali consecutive (intervallo 50 ms) per considerare rimossa o inserita una memoria
+#define SWAP_REMOVED_POLLS 4
+#define SWAP_INSERTED_POLLS 10
+
+// firma per il rilevamento del cambio memoria: indirizzi e valori programmati, mai 0xFF (il valore di una memoria
+// vuota), count = 0 se l'immagine contiene solo bytes 0xFF
+typedef struct {
+  int count;
+  int address[SWAP_SIGNATURE_BYTES];
+  int value[SWAP_SIGNATURE_BYTES];
+} chip_signature;
+
+// indice delle immagini conosciute: nome del file nella directory delle immagini, dimensione dei blocchi
+// e dimensione massima di un'immagine (la memoria più grande della tabella)
+#define INDEX_FILENAME "AT28C.idx"
+#define INDEX_BLOCK_SIZE 256
+#define INDEX_MAX_SIZE 32768
+
+// immagine conosciuta: file di origine, CRC16 dell'immagine e dei blocchi (l'ultimo blocco è completato con 0xFF)
+typedef struct {
+  char name[256];
+  long long filesize;
+  long long mtime;
+  size_t size;
+  unsigned short crc;
+  int blocks;
+  unsigned short blockcrc[INDEX_MAX_SIZE / INDEX_BLOCK_SIZE];
+} image_entry;
+
+// operazioni eseguibili in sequenza con una sola connessione (-o wp,v,r)
+#define MAX_STEPS 8
+
+// operazione della sequenza con le relative modalità
+typedef struct {
+  char spec[8];
+  char operation;
+  bool paged;
+  bool sdp;
+  bool singlebyte;
+  bool diagreset;
+} op_step;
+
+// blocchi e dimensione massima della copia host del contenuto della memoria
+#define SHADOW_BLOCK_SIZE 256
+#define SHADOW_MAX_SIZE 32768
+
+// copia host del contenuto della memoria, aggiornata dalle scritture confermate e dalle letture: i blocchi noti
+// vengono confermati dai checksum del programmatore e non vengono trasferiti nuovamente dalle letture
+typedef struct {
+  unsigned char data[SHADOW_MAX_SIZE];
+  bool known[SHADOW_MAX_SIZE / SHADOW_BLOCK_SIZE];
+} shadow_image;
+
+// richiesta di interruzione dell'operazione in corso (CTRL+C)
+volatile sig_atomic_t cancelled = 0;
+
+// standard output originale per il contenuto letto con -f - o -r - (i messaggi vengono inviati allo standard error)
+int rawstdout = -1;
+
+// file di traccia del traffico seriale (NULL = nessuna registrazione) e istante dell'ultimo record
+FILE* tracefile = NULL;
+long long tracelast = 0;
+
+// legge dalla seriale del programmatore registrando i bytes ricevuti nella traccia
+ssize_t serialRead(int fd, void* buf, size_t len);
+
+// scrive sulla seriale del programmatore registrando i bytes inviati nella traccia
+ssize_t serialWrite(int fd, const void* buf, size_t len);
+
+// registra un record nella traccia
+void traceRecord(char direction, const void* buf, size_t len);
+
+// registra nella traccia il traffico delle operazioni della libreria
+void onTrace(char direction, const void* buf, size_t len, void* user);
+
+// avanzamento di una operazione della libreria: descrizione, ultima percentuale visualizzata e bytes completati;
+// con data i bytes completati vengono scritti man mano su outfd calcolandone il CRC
+typedef struct {
+  const char* label;
+  int lastperc;
+  size_t done;
+  const unsigned char* data;
+  int outfd;
+  size_t written;
+  unsigned short crc;
+} progress_state;
+
+// visualizza la percentuale di avanzamento di una operazione della libreria
+void onProgress(at28c_session* session, size_t done, size_t total, void* user);
+
+// visualizza i primi tre bytes riletti diversi dall'immagine
+void onMismatch(at28c_session* session, size_t address, unsigned char expected, unsigned char actual, void* user);
+
+// attende il termine dell'operazione avviata sulla sessione, CTRL+C la interrompe riallineando il programmatore
+int waitOperation(at28c_session* session);
 
-// invia il comando di richiesta della versione del firmware
-int requestFirmware(int fd);
+// invia un comando e attende la risposta che inizia con expected (con last le righe fino alla riga last), il
+// programmatore deve inviare un byte almeno ogni msec millisecondi; ritorna le righe ricevute, NULL in caso di errore
+const char* requestAnswer(at28c_session* session, const char* cmd, const char* expected, const char* last, long msec);
 
-// invia il comando di richiesta lettura della memoria
-int requestRead(int fd, e_rom_type romtype);
+// restituisce un tempo monotono in microsecondi
+long long getMicros();
 
-// invia il comando di richiesta scrittura della memoria
-int requestWrite(int fd, e_rom_type romtype, bool paged);
+// invia al prorammatore i dati da scrivere leggendoli dall'immagine in memoria, con sdp ogni byte o pagina è preceduto
+// dalla sequenza di sblocco, con rle le pagine vengono trasferite compresse
+int writeEprom(at28c_session* session, bool paged, bool sdp, bool rle, int window, const unsigned char* image);
 
-// legge e visualizza o salva nel buffer la risposta dal programmatore
-int readAnswer(int fd, char* buffer, long msec);
+// scrive la memoria con l'immagine letta da infd man mano che arriva, calcolando il CRC dei bytes ricevuti:
+// con fill diverso da -1 un'immagine più corta della memoria viene completata con fill, image riceve l'immagine scritta
+int writeEpromStream(at28c_session* session, e_rom_type romtype, bool paged, bool sdp, int window, int infd, int fill, unsigned char* image);
 
-// legge la risposta dal programmatore con il contenuto della memoria e lo salva sul file indicato, attende la risposta per max msec millisecondi 
-int readEprom(int fd, e_rom_type romtype, char* filename, long msec);
+// restituisce la dimensione in bytes della memoria selezionata
+size_t getRomSize(e_rom_type romtype);
 
-// legge la risposta dal programmatore con il contenuto della memoria e lo verifica con il contenuto del file indicato, attende la risposta per max msec millisecondi 
-int verifyEprom(int fd, e_rom_type romtype, char* filename, long msec);
+// mappa in memoria in sola lettura il file immagine, len riceve la dimensione del file
+const unsigned char* mapImage(char* filename, size_t* len);
 
-// invia al prorammatore i dati da scrivere leggendoli dal file indicato, per ogni byte attende al massimo msecforbyte millisecondi
-int writeEprom(int fd, e_rom_type romtype, bool paged, char* filename, long msecforbyte);
+// legge un numero di una vista (decimale o preceduto da x per esadecimale)
+bool parseViewNumber(const char* s, size_t* value);
 
-// setup Software Data Protection
-int setupSDP(int fd, bool enable, long msec);
+// interpreta la vista (operazioni separate da virgola) per la memoria member del set, filelen è la dimensione del file
+int parseView(char* spec, size_t filelen, size_t chipsize, int member, image_view* view);
 
-// invia al programmatore la locazione di memoria e il byte da scrivere
-int requestWriteByte(int fd, int address, unsigned char val, long msecforbyte);
+// restituisce i bytes della vista per una memoria: direttamente dal file mappato se contigui, altrimenti composti in scratch
+const unsigned char* viewData(const unsigned char* base, size_t filelen, image_view* view, size_t chipsize, unsigned char* scratch);
 
-// legge al programmatore la locazione di memoria da leggere
-int requestReadByte(int fd, int address, long msecforbyte);
+// calcola la firma per il cambio memoria: i primi bytes dell'immagine diversi da una memoria vuota o azzerata,
+// completati con i bytes azzerati
+void imageSignature(const unsigned char* image, size_t len, chip_signature* signature);
+
+// legge i bytes della firma dalla memoria inserita
+int readSignature(at28c_session* session, const chip_signature* signature, int* values);
+
+// richiede al programmatore il CRC16 di un'area della memoria
+int requestChecksum(at28c_session* session, unsigned int start, unsigned int len, unsigned short* crc, long msec);
+
+// legge il valore del byte alla locazione indicata senza visualizzare messaggi
+int readByteValue(at28c_session* session, int address, long msec);
+
+// attende la sostituzione della memoria nello zoccolo o la pressione di invio
+int waitChipSwap(at28c_session* session, const chip_signature* programmed);
+
+// programma in sequenza più memorie con la stessa immagine mantenendo aperta la comunicazione,
+// prima di ogni memoria verifica il bus sulle locazioni all'indirizzo indicato
+int batchWrite(at28c_session* session, e_rom_type romtype, bool paged, bool sdp, bool rle, int window, const unsigned char* image, int count, char* logname, int address);
+
+// restituisce un tempo monotono in millisecondi
+long long getMillis();
+
+// richiede al programmatore il riconoscimento della memoria inserita e dello stato del software data protection
+int requestProbe(at28c_session* session, e_rom_type* romtype, bool* sdpactive, long msec);
+
+// gestione della richiesta di interruzione (CTRL+C)
+void onInterrupt(int sig);
+
+// verifica se il firmware supporta i trasferimenti compressi RLE
+int requestRLE(at28c_session* session, long msec);
+
+// richiede la dimensione del buffer di ricezione seriale del firmware
+int requestRxBuffer(at28c_session* session, long msec);
+
+// legge l'intera memoria con il trasferimento indicato (blocchi verificati da CRC, flusso continuo o compresso RLE),
+// con outfd diverso da -1 i bytes ricevuti vengono scritti man mano sul descrittore
+int readEprom(at28c_session* session, e_rom_type romtype, at28c_transfer transfer, unsigned char* data, int outfd);
+
+// apre il file su cui salvare il contenuto letto, - indica lo standard output
+int openOutput(char* filename);
+
+// salva il contenuto letto sul file indicato o lo visualizza se non è indicato un file
+int saveEprom(char* filename, unsigned char* data, size_t len);
+
+// confronta il contenuto letto con l'immagine
+int compareImage(const unsigned char* image, unsigned char* data, size_t len);
+
+// verifica lo schema di programmazione (ADDR, ADDRX o fino a 8 bytes esadecimali) e lo converte in maiuscolo
+int checkFillPattern(char* pattern);
+
+// programma un'area della memoria con uno schema generato dal programmatore, senza trasferire i dati
+int requestFill(at28c_session* session, e_rom_type romtype, int start, int len, char* pattern, bool sdp);
+
+// misura i cicli di scrittura dell'intera memoria, per pagina o per blocco di SCAN_BLOCK_SIZE bytes: ogni blocco
+// viene scritto con il complemento di original e ripristinato, salva le durate (us) e i bytes non verificati
+int requestScan(at28c_session* session, e_rom_type romtype, bool sdp, const unsigned char* original, unsigned short* test, unsigned short* restore, unsigned char* errors);
+
+// riscrive con il contenuto originale il blocco di len bytes all'indirizzo indicato di una scansione interrotta,
+// se non riesce salva l'intero contenuto originale nel file di recupero
+int restoreScanBlock(at28c_session* session, e_rom_type romtype, bool sdp, const unsigned char* original, int address, int len);
+
+// visualizza la mappa dei cicli di scrittura e le statistiche, salva i risultati per blocco nel file CSV se indicato
+// ritorna 0 se la memoria è accettata (nessun errore e durate entro threshold us), 1 se scartata, -1 in caso di errore
+int reportScan(e_rom_type romtype, const unsigned short* test, const unsigned short* restore, const unsigned char* errors, long threshold, char* csvname);
+
+// richiede la ricerca del profilo di temporizzazione più veloce, utilizza l'area all'indirizzo indicato come prova
+int requestTune(at28c_session* session, e_rom_type romtype, int address, long msec);
+
+// converte una cifra esadecimale, -1 se non valida
+int hexDigit(char c);
+
+// carica un'immagine binaria (.bin) o Intel HEX (.hex), size riceve la dimensione dell'immagine
+int loadIndexImage(const char* filename, unsigned char* data, size_t* size);
+
+// calcola i CRC dell'immagine e dei blocchi di una voce dell'indice
+void indexImage(image_entry* entry, unsigned char* data, size_t size);
+
+// aggiorna l'indice delle immagini presenti nella directory, ricalcolando solo i file nuovi o modificati
+int updateImageIndex(const char* dirname, image_entry** entries, int* count);
+
+// richiede al programmatore i CRC16 dei blocchi di un'area della memoria
+int requestBlockSums(at28c_session* session, size_t start, size_t len, int blocksize, unsigned short* crcs, long msec);
+
+// identifica l'immagine presente nella memoria confrontando i CRC dei blocchi con l'indice della directory
+int identifyEprom(at28c_session* session, e_rom_type romtype, char* dirname);
+
+// riceve fino a len bytes dal programmatore visualizzando la percentuale, attende ogni blocco di dati per max msec millisecondi
+// ritorna il numero di bytes ricevuti, -1 in caso di errore o interruzione
+ssize_t receiveData(at28c_session* session, unsigned char* buf, size_t len, long msec);
+
+// legge l'intera memoria campionando ogni indirizzo samples volte, salva i valori di maggioranza in data
+// e visualizza gli indirizzi con letture instabili
+int readEpromVoted(at28c_session* session, e_rom_type romtype, int samples, unsigned char* data, long msec);
+
+// richiede e visualizza i contatori diagnostici del programmatore, con reset li azzera dopo la lettura
+int requestDiag(at28c_session* session, bool reset, long msec);
+
+// visualizza le linee indicate da una maschera (es. A3 A5), ritorna il numero di linee
+int printLines(char prefix, unsigned int mask);
+
+// verifica walking-bit delle linee di indirizzo e dati sulle locazioni di prova all'indirizzo indicato,
+// ritorna 0 se il bus è integro, 1 con linee bloccate o in corto, -1 in caso di errore
+int requestSelfTest(at28c_session* session, int address, long msec);
+
+// invia al programmatore la locazione di memoria e il byte da scrivere, ritorna il byte presente nella memoria dopo
+// la scrittura, -1 in caso di errore
+int requestWriteByte(at28c_session* session, int address, unsigned char val, long msec);
+
+// legge al programmatore la locazione di memoria da leggere, ritorna il byte letto, -1 in caso di errore
+int requestReadByte(at28c_session* session, int address, long msec);
+
+// interpreta una operazione della sequenza (es. wps), ritorna -1 se sconosciuta
+int parseOperation(const char* spec, op_step* step);
+
+// segna come noti i blocchi dell'area indicata (start e len multipli di SHADOW_BLOCK_SIZE) copiandone il contenuto
+void shadowStore(shadow_image* shadow, size_t start, const unsigned char* data, size_t len);
+
+// invalida l'intera copia del contenuto della memoria
+void shadowClear(shadow_image* shadow);
+
+// numero di bytes noti della copia del contenuto della memoria
+size_t shadowKnown(const shadow_image* shadow, size_t size);
+
+// completa la copia del contenuto della memoria leggendo in blocchi verificati solo le aree non note
+int readShadow(at28c_session* session, e_rom_type romtype, shadow_image* shadow);
+
+// conferma la copia del contenuto della memoria con i checksum dei blocchi calcolati dal programmatore,
+// legge i blocchi non confermati e confronta la copia con l'immagine, ritorna -1 in caso di errore o differenze
+int verifyShadow(at28c_session* session, e_rom_type romtype, const unsigned char* image, shadow_image* shadow);
 
 // applicazione principale
 int main (int argc, char **argv) {
@@ -59,6 +349,9 @@ int main (int argc, char **argv) {
   // indicatore operazione paginata
   bool paged = false;
 
+  // indicatore scrittura con sequenza di sblocco del software data protection
+  bool sdp = false;
+
   // indicatore leura scrittura singolo byte
   bool singlebyte = false;
 
@@ -74,9 +367,56 @@ int main (int argc, char **argv) {
   // valore da scrivere
   int val = -1;
 
+  // numero di memorie da programmare in modalità batch (0 = fino ad interruzione)
+  int batchcount = -1;
+
+  // nome del file di log della modalità batch
+  char *logname = NULL;
+
+  // indicatore riconoscimento automatico della memoria
+  bool autotype = false;
+
+  // indicatore trasferimenti compressi RLE
+  bool rle = false;
+
+  // indicatore letture in blocchi verificati da CRC
+  bool checked = false;
+
+  // numero di campioni per indirizzo della lettura con voto di maggioranza
+  int samples = 0;
+
+  // schema e lunghezza dell'area da programmare con FILL (-1 = fino al termine della memoria)
+  char *pattern = NULL;
+  int length = -1;
+
+  // vista sul file immagine da scrivere o verificare
+  char *viewspec = NULL;
+
+  // file di registrazione del traffico seriale
+  char *tracename = NULL;
+
+  // connessione senza reset del programmatore
+  bool keepalive = false;
+
+  // azzeramento dei contatori diagnostici dopo la lettura
+  bool diagreset = false;
+
+  // sequenza delle operazioni richieste
+  op_step steps[MAX_STEPS];
+  int nsteps = 0;
+
+  // file del contenuto letto quando -f è l'immagine di altre operazioni della sequenza
+  char *dumpname = NULL;
+
+  // file CSV dei risultati della scansione dei cicli di scrittura
+  char *csvname = NULL;
+
+  // durata massima accettata di un ciclo di scrittura in us (-1 = tWC della memoria)
+  long threshold = -1;
+
   // effettua il parsing dei parametri passati da linea di comando
   int c;
-  while ((c = getopt (argc, argv, "d:f:t:o:a:b:")) != -1) {
+  while ((c = getopt (argc, argv, "d:f:t:o:a:b:n:l:zcm:x:s:v:T:kC:u:r:")) != -1) {
     switch (c) {
       // nome della seriale alla quale è connesso il programmatore
       case 'd':
@@ -88,45 +428,30 @@ int main (int argc, char **argv) {
         break;
       // selezione tipologia di memoria
       case 't':
-        if (strcmp("AT28C64", optarg) == 0) romtype = AT28C64;
-        if (strcmp("AT28C256", optarg) == 0) romtype = AT28C256;
-        if (romtype == NONE) {
+        for (int i = 0; i < NONE; i++) {
+          if (strcmp(romtypes[i].name, optarg) == 0) romtype = i;
+        }
+        if (strcmp("auto", optarg) == 0) autotype = true;
+        if (romtype == NONE && !autotype) {
           printf("unknown romtype\n");
         }
         break;
-      case 'o':
-        // opzione per la scrittura della memoria
-        if (optarg[0] == 'w') {
-          operation = 'w';
-          // opzione per la scrittura della memoria paginata
-          if (optarg[1] == 'p') {
-            paged = true;
-          }
-          // opzione per la scrittura di un byte
-          if (optarg[1] == 'b') {
-            singlebyte = true;
+      case 'o': {
+        // operazioni separate da virgola, eseguite in sequenza con la stessa connessione
+        char spec[strlen(optarg) + 1];
+        strcpy(spec, optarg);
+        nsteps = 0;
+        char* save;
+        for (char* tok = strtok_r(spec, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+          if (nsteps == MAX_STEPS || parseOperation(tok, &steps[nsteps]) == -1) {
+            printf("unknown operation\n");
+            nsteps = 0;
+            break;
           }
-        // opzione per la verifica della memoria
-        } else if (optarg[0] == 'v') {
-          operation = 'v';
-        // opzione per la lettura della memoria
-        } else if (optarg[0] == 'r') {
-          operation = 'r';
-          // opzione per la lettura di un byte
-          if (optarg[1] == 'b') {
-            singlebyte = true;
-          }
-        // opzione per l'abilitazione del software data protection
-        } else if (optarg[0] == 'e') {
-          operation = 'e';
-        // opzione per la disabilitazione del software data protection
-        } else if (optarg[0] == 'd') {
-          operation = 'd';
-        }
-        else {
-          printf("unknown operation\n");
+          nsteps++;
         }
         break;
+      }
       // indirizzo da leggere o scrivere
       case 'a':
         if (optarg[0] == 'x') {
@@ -149,457 +474,1611 @@ int main (int argc, char **argv) {
           return -1;
         }
         break;
+      // numero di memorie da programmare in modalità batch
+      case 'n':
+        batchcount = atoi(optarg);
+        if (batchcount < 0) {
+          printf("wrong batch count\n");
+          return -1;
+        }
+        break;
+      // file di log della modalità batch
+      case 'l':
+        logname = optarg;
+        break;
+      // trasferimenti compressi
+      case 'z':
+        rle = true;
+        break;
+      // letture verificate da CRC
+      case 'c':
+        checked = true;
+        break;
+      // lettura con campionamento multiplo
+      case 'm':
+        samples = atoi(optarg);
+        // con un numero pari di campioni la maggioranza non è definita
+        if (samples < 1 || samples > 31 || samples % 2 == 0) {
+          printf("wrong samples count\n");
+          return -1;
+        }
+        break;
+      // schema da programmare
+      case 'x':
+        pattern = optarg;
+        if (checkFillPattern(pattern) == -1) {
+          printf("wrong fill pattern\n");
+          return -1;
+        }
+        break;
+      // vista sul file immagine
+      case 'v':
+        viewspec = optarg;
+        break;
+      // registrazione del traffico seriale
+      case 'T':
+        tracename = optarg;
+        break;
+      // connessione senza reset
+      case 'k':
+        keepalive = true;
+        break;
+      // file del contenuto letto nelle sequenze di operazioni
+      case 'r':
+        dumpname = optarg;
+        break;
+      // file CSV della scansione dei cicli di scrittura
+      case 'C':
+        csvname = optarg;
+        break;
+      // soglia di accettazione della scansione dei cicli di scrittura
+      case 'u':
+        threshold = atol(optarg);
+        if (threshold <= 0 || threshold >= SCAN_TIMEOUT_US) {
+          printf("wrong threshold\n");
+          return -1;
+        }
+        break;
+      // lunghezza dell'area da programmare
+      case 's':
+        if (optarg[0] == 'x') {
+          sscanf(optarg + 1, "%x", &length);
+        } else {
+          length = atoi(optarg);
+        }
+        if (length <= 0) {
+          printf("wrong length\n");
+          return -1;
+        }
+        break;
     }
   }
 
-  if (address >= 8192 && romtype == AT28C64) {
+  if (romtype != NONE && address >= (int)getRomSize(romtype)) {
     printf("wrong address\n");
     address = -1; // print help if needed
   }
 
-  if (address >= 32768 && romtype == AT28C256) {
-    printf("wrong address\n");
-    address = -1; // print help if needed
+  // verifica gli argomenti obbligatori di ogni operazione della sequenza
+  bool wrongargs = device == NULL || nsteps == 0 || (batchcount != -1 && nsteps > 1);
+  // con altre operazioni su file immagine il contenuto letto viene salvato nel file -r
+  bool imagefile = false;
+  bool probe = false;
+  for (int step = 0; step < nsteps; step++) {
+    operation = steps[step].operation;
+    sdp = steps[step].sdp;
+    singlebyte = steps[step].singlebyte;
+    if ((romtype == NONE && !autotype && operation != 'p') ||
+        (filename == NULL && (operation == 'w' || operation == 'v' || operation == 'i') && singlebyte == false) ||
+        (address == -1 && (operation == 'w' || operation == 'r') && singlebyte == true) ||
+        (val == -1 && operation == 'w' && singlebyte == true) ||
+        (batchcount != -1 && (operation != 'w' || singlebyte == true)) ||
+        (pattern == NULL && operation == 'f') ||
+        (sdp && singlebyte == true)) {
+      wrongargs = true;
+    }
+    if (((operation == 'w' && !singlebyte) || operation == 'v' || operation == 'h' || operation == 'i') && filename != NULL) {
+      imagefile = true;
+    }
+    if (operation == 'p') {
+      probe = true;
+    }
+  }
+  if (dumpname == NULL && !imagefile) {
+    dumpname = filename;
   }
 
   // se non sono stati impostati gli argomenti obbligatori visualizza l'help ed esce
-  if (device == NULL ||
-      operation == 0 ||
-      romtype == NONE ||
-      (filename == NULL && (operation == 'w' || operation == 'v') && singlebyte == false) ||
-      (address == -1 && (operation == 'w' || operation == 'r') && singlebyte == true) ||
-      (val == -1 && operation == 'w' && singlebyte == true)) {
+  if (wrongargs) {
     printf("AT28CProgrammer V.1.01\n");
-    printf("use: AT28CProgrammer -d <device> -t <romtype> -o <operation> [-a <address>] [-b <byte>] [-f <filename>]\n");
+    printf("use: AT28CProgrammer -d <device> -t <romtype> -o <operation> [-a <address>] [-b <byte>] [-f <filename>] [-n <count>] [-l <logfile>] [-z] [-c] [-m <samples>] [-x <pattern>] [-s <length>] [-v <view>] [-T <tracefile>] [-k] [-C <csvfile>] [-u <us>] [-r <dumpfile>]\n");
     printf("\t-d: serial port\n");
-    printf("\t-t AT28C64: eeprom type AT28C64\n");
-    printf("\t-t AT28C256: eeprom type AT28C256\n");
+    for (int i = 0; i < NONE; i++) {
+      printf("\t-t %s: eeprom type %s (%zu bytes, %s%s)\n", romtypes[i].name, romtypes[i].name, romtypes[i].size,
+             romtypes[i].pagesize > 1 ? "paged write" : "byte write", romtypes[i].sdp ? ", SDP" : "");
+    }
+    printf("\t-t auto: detect eeprom type and software data protection, select paged and SDP write modes\n");
     printf("\t-o r: set to read eprom (save to file or dump to screen if no file selected)\n");
     printf("\t-o rb: set to read byte (needed -a parameter)\n");
     printf("\t-o w: set to write eprom\n");
-    printf("\t-o wp: set to paged write eprom (only supported by AT28C256)\n");
+    printf("\t-o wp: set to paged write eprom (only supported by paged write eeproms)\n");
     printf("\t-o wb: set to write byte (needed -a and -b parameters)\n");
+    printf("\t-o ws, -o wps: set to write eprom with software data protection enabled (every byte or page is preceded\n");
+    printf("\t               by the SDP unlock sequence, the eprom stays protected), modifiers in any order (-o wsp)\n");
     printf("\t-o v: set to verify eprom\n");
     printf("\t-o e: set to enable software data protection\n");
     printf("\t-o d: set to disable software data protection\n");
+    printf("\t-o p: set to probe eeprom type and software data protection state\n");
+    printf("\t-o t: set to tune bus timing, the fastest safe profile is stored in the programmer\n");
+    printf("\t      (uses 16 bytes at -a address as scratch area and restores them, default address 0)\n");
+    printf("\t-o s: set to self test the address and data lines (walking ones/zeros on a few locations at -a address\n");
+    printf("\t      and its complement, original contents restored), also run before every chip in batch mode\n");
+    printf("\t-o g: set to show the programmer diagnostic counters (serial traffic and errors, free SRAM,\n");
+    printf("\t      write cycle waits, time spent per command), -o gr also resets them\n");
+    printf("\t-o h, -o hs: set to scan the write cycle time of every page (or %d bytes block of byte write eeproms),\n", SCAN_BLOCK_SIZE);
+    printf("\t             each block is written with its complement and restored with the -f image (default: the\n");
+    printf("\t             current contents, read first), shows a map of the timings and accepts or rejects the chip,\n");
+    printf("\t             hs precedes every write with the SDP unlock sequence\n");
+    printf("\t-o i: set to identify the eprom image among the .bin/.hex files of the -f directory, using only\n");
+    printf("\t      on-device block checksums (the index is kept in %s inside the directory)\n", INDEX_FILENAME);
+    printf("\t-o f, -o fs: set to fill eprom with the -x pattern generated by the programmer, from -a address (default 0)\n");
+    printf("\t             for -s bytes (default up to the end), fs precedes every page with the SDP unlock sequence\n");
+    printf("\t-o <op>,<op>,...: run the operations in sequence with a single connection (e.g. -o wp,v,r), the chip\n");
+    printf("\t                  contents confirmed by writes and reads are kept on the host: verify compares them with\n");
+    printf("\t                  the programmer block checksums and reads transfer only the blocks not already known\n");
     printf("\t-a: address to read or write for single byte mode (decimal or preceded with x for hex)\n");
     printf("\t-b: byte to write for single byte mode (decimal or preceded with x for hex)\n");
-    printf("\t-f: file name to read or write\n");
+    printf("\t-f: file name to read or write, - streams the image from standard input (write only, a shorter image\n");
+    printf("\t    needs -v fill:<byte>) or the raw contents to standard output (read, messages go to standard error),\n");
+    printf("\t    the write starts after %d bytes and the input must then keep up with it\n", STREAM_LEAD_BYTES);
+    printf("\t-n: batch mode, program <count> chips with the same image (0 = until interrupted, only with -o w or -o wp)\n");
+    printf("\t-l: append batch mode pass/fail results to log file\n");
+    printf("\t-z: compressed (RLE) transfer for read, verify and paged write\n");
+    printf("\t-c: read and verify in CRC checked blocks, corrupted blocks are read again (not compressed)\n");
+    printf("\t-m: read sampling every address <samples> times (1-31, odd) and keep the majority value,\n");
+    printf("\t    addresses with unstable reads are listed as weak cells\n");
+    printf("\t-x: fill pattern, up to 8 hex bytes repeated from the start address (e.g. EA, 55AA),\n");
+    printf("\t    ADDR (address low byte) or ADDRX (address low byte xor high byte)\n");
+    printf("\t-s: fill length (decimal or preceded with x for hex)\n");
+    printf("\t-v: view on the image file for write and verify, comma separated steps applied in order (numbers\n");
+    printf("\t    decimal or preceded with x for hex), the file is mapped and never copied to temporary files:\n");
+    printf("\t      offset:<n>             skip the first n bytes\n");
+    printf("\t      length:<n>             use at most n bytes\n");
+    printf("\t      fill:<byte>            value of the bytes past the length or the end of file (default: error)\n");
+    printf("\t      interleave:<n>:<lane>  one byte every n starting from lane, lane * programs a set of n chips\n");
+    printf("\t      bank:<b>[:<size>]      bank b of size bytes (default eeprom size), b * programs a chip per bank\n");
+    printf("\t-T: record every byte exchanged with the programmer, with timestamps, to the trace file\n");
+    printf("\t    (analyze it or replay it on a pseudo terminal with AT28CTrace)\n");
+    printf("\t-k: connect without resetting the programmer and keep it running on exit (DTR is not dropped),\n");
+    printf("\t    the first run after plugging or a run without -k still resets it\n");
+    printf("\t-r: file to save the read contents to when -f is the image of another operation of the sequence (- = stdout)\n");
+    printf("\t-C: save the write cycle scan results to a CSV file (one row per block)\n");
+    printf("\t-u: write cycle scan threshold in us, slower blocks reject the chip (default: eeprom tWC)\n");
     printf("read  example:      AT28CProgrammer -d /dev/ttyUSB0 -t AT28C256 -o r -f /tmp/dump.bin\n");
     printf("write example:      AT28CProgrammer -d /dev/ttyUSB0 -t AT28C64 -o w -f /tmp/towrite.bin\n");
     printf("read byte example:  AT28CProgrammer -d /dev/ttyUSB0 -t AT28C64 -o rb -a 4096\n");
     printf("read byte example:  AT28CProgrammer -d /dev/ttyUSB0 -t AT28C64 -o rb -a x1000\n");
+    printf("probe example:      AT28CProgrammer -d /dev/ttyUSB0 -o p\n");
+    printf("tune example:       AT28CProgrammer -d /dev/ttyUSB0 -t AT28C256 -o t -a x7FF0\n");
+    printf("batch example:      AT28CProgrammer -d /dev/ttyUSB0 -t AT28C256 -o wp -f /tmp/towrite.bin -n 20 -l /tmp/batch.log\n");
+    printf("fill example:       AT28CProgrammer -d /dev/ttyUSB0 -t AT28C64 -o f -x EA\n");
+    printf("identify example:   AT28CProgrammer -d /dev/ttyUSB0 -t auto -o i -f ~/firmwares\n");
+    printf("health example:     AT28CProgrammer -d /dev/ttyUSB0 -t AT28C256 -o h -u 5000 -C /tmp/scan.csv\n");
+    printf("chain example:      AT28CProgrammer -d /dev/ttyUSB0 -t AT28C256 -o wp,v,r -f /tmp/towrite.bin -r /tmp/archive.bin\n");
+    printf("pipe example:       ./build_rom.sh | AT28CProgrammer -d /dev/ttyUSB0 -t AT28C256 -o wp -f - -v fill:xFF\n");
+    printf("16 bit set example: AT28CProgrammer -d /dev/ttyUSB0 -t AT28C256 -o wp -f /tmp/rom16.bin -v interleave:2:*\n");
     return -1;
   }
 
-  // visualizza la memoria selezionata
-  if (romtype == AT28C64) {
-    printf("selected AT28C64\n");
-  } else if (romtype == AT28C256) {
-    printf("selected AT28C256\n");
+  // lo standard input è consumato dalla sola scrittura, man mano che procede
+  if (filename != NULL && strcmp(filename, "-") == 0) {
+    for (int step = 0; step < nsteps; step++) {
+      if (steps[step].operation == 'v' || steps[step].operation == 'i' || steps[step].operation == 'h' || batchcount != -1) {
+        printf("standard input supported only by single write\n");
+        return -1;
+      }
+    }
   }
 
-  // apre la comunicazione con il programmatore tramite la porta seriale
-  int fd = open(device, O_RDWR | O_NOCTTY | O_NDELAY);
-  if (fd == -1) {
-    printf("open_port: Unable to open device\n");
-    return -1;
+  // il contenuto letto sullo standard output è binario, i messaggi vengono inviati allo standard error
+  if (dumpname != NULL && strcmp(dumpname, "-") == 0) {
+    rawstdout = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    setvbuf(stdout, NULL, _IOLBF, 0);
   }
 
-  // impostazione dei parametri della porta seriale
-  struct termios tio;
-  if (tcgetattr(fd, &tio) != 0) {
-    close(fd);
-    printf("error tcgetattr\n");
-    return -1;
+  // visualizza la memoria selezionata
+  if (romtype != NONE) {
+    printf("selected %s\n", romtypes[romtype].name);
   }
 
-  // minimum number of character for non canonical read
-  tio.c_cc[VMIN] = 1;
-  // timeout in deciseconds for non canonical read
-  tio.c_cc[VTIME] = 0;
-  tio.c_iflag = 0;
-  tio.c_lflag = 0;
-  tio.c_cflag = 0;
-  tio.c_oflag = 0;
-
-  // ignore break condition on input
-  tio.c_iflag |= IGNBRK;
-  // 8 bit data
-  tio.c_cflag |= CS8;
-  // enable receiver, lower modem contron on close device, ignore input modem control lines
-  tio.c_cflag |= CREAD | HUPCL | CLOCAL;
-
-  // 115200 baud
-  cfsetispeed(&tio, B115200);
-  cfsetospeed(&tio, B115200);
+  // CTRL+C interrompe l'operazione in corso lasciando il programmatore allineato
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onInterrupt;
+  sigaction(SIGINT, &sa, NULL);
+
+  // apre il file di traccia del traffico seriale
+  if (tracename != NULL) {
+    tracefile = fopen(tracename, "wb");
+    if (tracefile == NULL) {
+      printf("error opening trace file\n");
+      return -1;
+    }
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), tracefile);
+    tracelast = getMicros();
+  }
 
-  // apply settings to serial port
-  if (tcsetattr(fd, TCSANOW, &tio) != 0) {
-    close(fd);
-    printf("error tcsetattr\n");
+  // apre la comunicazione con il programmatore tramite la porta seriale (115200 8N1), con -k il DTR resta attivo
+  // alla chiusura e la successiva apertura non resetta il programmatore
+  at28c_session* session = at28cOpen(device, keepalive);
+  if (session == NULL) {
+    printf("open_port: Unable to open device\n");
     return -1;
   }
+  if (tracefile != NULL) {
+    at28cSetTrace(session, onTrace, NULL);
+  }
 
-  // imposta la seriale in modalità non blocking durante la lettura e pulisce eventuali comunicazioni residue
-  fcntl(fd, F_SETFL, FNDELAY);
-  usleep(100000);
-  tcflush(fd, TCIOFLUSH);
-
-  // invia il comando di richiesta firmware
-  if (requestFirmware(fd) == -1) {
-    close(fd);
-    printf("error request firmware version\n");
+  // attende il programmatore (con reset l'intestazione inviata all'avvio) e ne legge la versione del firmware
+  at28cConnect(session, NULL);
+  if (waitOperation(session) != AT28C_OK) {
+    at28cClose(session);
+    printf("error reading firmware version\n");
     return -1;
   }
+  printf("+VERSION=%s\n", at28cVersion(session));
 
-  // attende la risposta per un massimo di 100 ms (se il dispositivo non è stato resettato nell'apertura della comunicazione risponderà qui)
-  if (readAnswer(fd, NULL, 100) == -1) {
-    // non ha ricevuto la risposta alla versione firmware
-    // attende l'eventuale intestazione inviata dal programmatore per massimo 1.5 secondi
-    if (readAnswer(fd, NULL, 1500) == -1) {
-      close(fd);
-      printf("error reading header\n");
-      return -1;
-    }
+  // negozia i trasferimenti compressi
+  if (rle && requestRLE(session, 100) == -1) {
+    printf("compressed transfer not supported by firmware\n");
+    rle = false;
+  }
 
-    // invia il comando di richiesta firmware
-    if (requestFirmware(fd) == -1) {
-      close(fd);
-      printf("error request firmware version\n");
+  // riconoscimento della memoria inserita
+  bool autopaged = false;
+  bool autosdp = false;
+  if (autotype || probe) {
+    bool sdpactive = false;
+    if (requestProbe(session, &romtype, &sdpactive, 1000) == -1) {
+      at28cClose(session);
+      printf("error probing eprom\n");
       return -1;
     }
+    printf("detected %s, software data protection %s\n", romtypes[romtype].name, sdpactive ? "enabled" : "disabled");
 
-    // attende la risposta contentente la versione firmware per un massimo di 100 ms
-    if (readAnswer(fd, NULL, 100) == -1) {
-      close(fd);
-      printf("error reading firmware version\n");
-      return -1;
+    if (autotype) {
+      if (address >= (int)getRomSize(romtype)) {
+        at28cClose(session);
+        printf("wrong address\n");
+        return -1;
+      }
+      // le memorie paginate scrivono sempre a pagine, con SDP attivo ogni scrittura viene preceduta dallo sblocco
+      autopaged = romtypes[romtype].pagesize > 1;
+      autosdp = sdpactive;
     }
   }
 
-  // verifica se richiesta verifica della memoria
-  if (operation == 'v') {
-    // invia il comando di richiesta lettura della memoria selezionata
-    if (requestRead(fd, romtype) == -1) {
-      close(fd);
-      printf("error request read eprom\n");
+  // seleziona la memoria sul programmatore (i firmware precedenti usano sempre i parametri della AT28C256)
+  if (romtype != NONE && (at28cSelectChip(session, at28cChip(romtypes[romtype].name), NULL) == -1 ||
+                          waitOperation(session) != AT28C_OK)) {
+    printf("eeprom selection not supported by firmware\n");
+  }
+
+  // copia del contenuto della memoria condivisa dalle operazioni della sequenza
+  shadow_image shadow;
+  shadowClear(&shadow);
+
+  for (int step = 0; step < nsteps; step++) {
+    operation = steps[step].operation;
+    paged = steps[step].paged;
+    sdp = steps[step].sdp;
+    singlebyte = steps[step].singlebyte;
+    diagreset = steps[step].diagreset;
+    if (autotype) {
+      paged = paged || autopaged;
+      sdp = autosdp;
+    }
+    if (nsteps > 1) {
+      printf("operation %d of %d: %s\n", step + 1, nsteps, steps[step].spec);
+    }
+
+    // verifica che la memoria supporti la modalità di scrittura richiesta
+    if (operation == 'w' && paged && romtypes[romtype].pagesize == 1) {
+      at28cClose(session);
+      printf("paged write not supported by %s\n", romtypes[romtype].name);
       return -1;
     }
-    // legge la risposta con il contenuto della memoria e lo verifica con quanto presente su file
-    if (verifyEprom(fd, romtype, filename, 100) == -1) {
-      close(fd);
-      printf("error verifying eprom\n");
+    if ((operation == 'w' || operation == 'f' || operation == 'h') && sdp && !romtypes[romtype].sdp) {
+      at28cClose(session);
+      printf("software data protection not supported by %s\n", romtypes[romtype].name);
       return -1;
     }
-  }
-  // verifica se richiesta scrittura della memoria
-  else if (operation == 'w') {
-    if (singlebyte) {
-      // invia il comando di richiesta scrittura della byte
-      if (requestWriteByte(fd, address, val, 100) == -1) {
-        close(fd);
-        printf("error request write byte\n");
+
+    // verifica se richiesta scrittura della memoria dallo standard input
+    if (operation == 'w' && !singlebyte && strcmp(filename, "-") == 0) {
+      // l'immagine arriva in ordine, della vista è utilizzato solo il riempimento di un'immagine più corta
+      size_t totalbytes = getRomSize(romtype);
+      image_view view;
+      if (parseView(viewspec, 0, totalbytes, 0, &view) == -1 || view.offset != 0 || view.stride != 1 ||
+          view.length != SIZE_MAX || view.setsize != 1) {
+        at28cClose(session);
+        printf("only fill view supported with standard input\n");
+        return -1;
+      }
+      int window = 1;
+      if (!paged) {
+        int rxbuffer = requestRxBuffer(session, 100);
+        if (rxbuffer > 1) {
+          window = rxbuffer / 2;
+          printf("pipelined byte write, %d bytes in flight\n", window);
+        }
+      }
+      unsigned char image[totalbytes];
+      if (writeEpromStream(session, romtype, paged, sdp, window, STDIN_FILENO, view.fill, image) != 0) {
+        at28cClose(session);
+        printf("error write eprom\n");
+        return -1;
+      }
+      shadowStore(&shadow, 0, image, totalbytes);
+    }
+    // verifica se richiesta verifica o scrittura della memoria da file immagine
+    else if (operation == 'v' || (operation == 'w' && !singlebyte)) {
+      // mappa il file, ogni memoria del set legge i propri bytes tramite la vista
+      size_t totalbytes = getRomSize(romtype);
+      size_t filelen;
+      const unsigned char* base = mapImage(filename, &filelen);
+      image_view view;
+      if (base == NULL || parseView(viewspec, filelen, totalbytes, 0, &view) == -1) {
+        at28cClose(session);
+        if (base != NULL) {
+          munmap((void*)base, filelen);
+          printf("wrong view\n");
+        }
+        printf("error %s eprom\n", operation == 'v' ? "verifying" : "write");
         return -1;
       }
-      // attende la risposta contentente il byte presente nella EPROM dopo la scrittura
-      char buffer[64];
-      if (readAnswer(fd, buffer, 100) == -1) {
-        close(fd);
-        printf("error reading firmware version\n");
+      if (view.setsize > 1 && (batchcount != -1 || nsteps > 1)) {
+        at28cClose(session);
+        munmap((void*)base, filelen);
+        printf("%s not supported with chip sets\n", batchcount != -1 ? "batch mode" : "operation chains");
         return -1;
       }
-      if (memcmp(buffer, "+WRITEBYTE=", 11) == 0) {
-        int wval;
-        sscanf(buffer + 11, "%d", &wval);
-        unsigned char c = (unsigned char)wval;
-        if (c != val) {
-          printf("write error, read byte %u [x%02X] at address %u [x%04X]\n", c, c, (unsigned int)address, (unsigned int)address);
+
+      // la compressione è utilizzata solo dalla scrittura paginata, senza modificare i passi successivi
+      bool steprle = rle && (operation != 'w' || paged);
+      at28c_transfer transfer = checked ? AT28C_BLOCKS : (steprle ? AT28C_STREAM_RLE : AT28C_STREAM);
+      // nella scrittura a singolo byte mantiene in transito metà del buffer di ricezione del firmware
+      // (l'altra metà resta disponibile per la riga di comando ancora in elaborazione)
+      int window = 1;
+      if (operation == 'w' && !paged) {
+        int rxbuffer = requestRxBuffer(session, 100);
+        if (rxbuffer > 1) {
+          window = rxbuffer / 2;
+          printf("pipelined byte write, %d bytes in flight\n", window);
+        }
+      }
+
+      unsigned char scratch[totalbytes];
+      // firma della memoria precedente del set
+      chip_signature signature;
+      int result = 0;
+      for (int member = 0; member < view.setsize && result == 0; member++) {
+        const unsigned char* image = NULL;
+        if (parseView(viewspec, filelen, totalbytes, member, &view) == -1) {
+          printf("wrong view\n");
+        } else {
+          image = viewData(base, filelen, &view, totalbytes, scratch);
+        }
+        if (image == NULL) {
+          printf("error %s eprom\n", operation == 'v' ? "verifying" : "write");
+          result = -1;
+          break;
+        }
+        if (view.setsize > 1) {
+          if (member > 0) {
+            // attende la memoria successiva del set, riconosciuta dal cambio della firma della precedente
+            printf("insert chip %d of %d and press enter (or swap chip)\n", member + 1, view.setsize);
+            fflush(stdout);
+            if (waitChipSwap(session, &signature) == -1) {
+              result = -1;
+              break;
+            }
+          }
+          printf("chip %d of %d: file offset %zu, stride %zu\n", member + 1, view.setsize, view.offset, view.stride);
+        }
+
+        if (operation == 'v' && shadowKnown(&shadow, totalbytes) > 0) {
+          // conferma con i checksum del programmatore il contenuto noto dalle operazioni precedenti
+          if (verifyShadow(session, romtype, image, &shadow) == -1) {
+            printf("error verifying eprom\n");
+            result = -1;
+          }
+        } else if (operation == 'v') {
+          // legge la memoria (in blocchi verificati, a flusso continuo o compresso) e la confronta con l'immagine
+          unsigned char data[totalbytes];
+          if (readEprom(session, romtype, transfer, data, -1) == -1) {
+            printf("error verifying eprom\n");
+            result = -1;
+          } else {
+            shadowStore(&shadow, 0, data, totalbytes);
+            if (compareImage(image, data, totalbytes) == -1) {
+              printf("error verifying eprom\n");
+              result = -1;
+            }
+          }
+        } else if (batchcount != -1) {
+          // programma in sequenza le memorie inserite dall'operatore
+          if (batchWrite(session, romtype, paged, sdp, steprle, window, image, batchcount, logname, address == -1 ? 0 : address) == -1) {
+            printf("error batch write eprom\n");
+            result = -1;
+          }
         } else {
-          printf("written byte %u [x%02X] at address %u [x%04X]\n", c, c, (unsigned int)address, (unsigned int)address);
+          // invia l'immagine da scrivere, ogni byte viene riletto e confrontato
+          if (writeEprom(session, paged, sdp, steprle, window, image) != 0) {
+            printf("error write eprom\n");
+            shadowClear(&shadow);
+            result = -1;
+          } else {
+            // ogni byte scritto è stato riletto e confrontato dal programmatore
+            shadowStore(&shadow, 0, image, totalbytes);
+          }
         }
+
+        imageSignature(image, totalbytes, &signature);
       }
-    } else {
-      // invia il comando di richiesta scrittura della memoria selezionata
-      if (requestWrite(fd, romtype, paged) == -1) {
-        close(fd);
-        printf("error request write eprom\n");
+      munmap((void*)base, filelen);
+      if (result == -1) {
+        at28cClose(session);
         return -1;
       }
-      // invia il contenuto del file da scrivere, per ogny byte scritto attende al massimo 10 ms per la scrittura
-      if (writeEprom(fd, romtype, paged, filename, 100) == -1) {
-        close(fd);
-        printf("error write eprom\n");
+    }
+    // verifica se richiesta scrittura di un byte
+    else if (operation == 'w') {
+      // invia il comando di richiesta scrittura del byte e attende il byte presente nella EPROM dopo la scrittura
+      int wval = requestWriteByte(session, address, val, 100);
+      if (wval == -1) {
+        at28cClose(session);
+        printf("error request write byte\n");
         return -1;
       }
+      unsigned char c = (unsigned char)wval;
+      if (shadow.known[address / SHADOW_BLOCK_SIZE]) {
+        shadow.data[address] = c;
+      }
+      if (c != val) {
+        printf("write error, read byte %u [x%02X] at address %u [x%04X]\n", c, c, (unsigned int)address, (unsigned int)address);
+      } else {
+        printf("written byte %u [x%02X] at address %u [x%04X]\n", c, c, (unsigned int)address, (unsigned int)address);
+      }
     }
-  }
-  // verifica se richiesta lettura della memoria
-  else if (operation == 'r') {
-    if (singlebyte) {
-      // invia il comando di richiesta scrittura della byte
-      if (requestReadByte(fd, address, 100) == -1) {
-        close(fd);
-        printf("error request read byte\n");
+    // verifica se richiesta lettura della memoria
+    else if (operation == 'r') {
+      if (singlebyte) {
+        // invia il comando di richiesta lettura del byte e attende il byte letto dalla EPROM
+        int rval = requestReadByte(session, address, 100);
+        if (rval == -1) {
+          at28cClose(session);
+          printf("error request read byte\n");
+          return -1;
+        }
+        unsigned char c = (unsigned char)rval;
+        printf("read byte %u [x%02X] at address %u [x%04X]\n", c, c, (unsigned int)address, (unsigned int)address);
+      } else if (shadowKnown(&shadow, getRomSize(romtype)) > 0) {
+        // legge solo le aree non note dalle operazioni precedenti e salva l'intero contenuto su file
+        if (readShadow(session, romtype, &shadow) == -1 || saveEprom(dumpname, shadow.data, getRomSize(romtype)) == -1) {
+          at28cClose(session);
+          printf("error reading eprom\n");
+          return -1;
+        }
+      } else if (samples > 0) {
+        // legge la memoria con voto di maggioranza e la salva su file
+        size_t totalbytes = getRomSize(romtype);
+        unsigned char data[totalbytes];
+        if (readEpromVoted(session, romtype, samples, data, 1000) == -1 || saveEprom(dumpname, data, totalbytes) == -1) {
+          at28cClose(session);
+          printf("error reading eprom\n");
+          return -1;
+        }
+      } else {
+        // legge la memoria (in blocchi verificati, a flusso continuo o compresso) e la salva su file,
+        // sullo standard output man mano che arriva
+        size_t totalbytes = getRomSize(romtype);
+        unsigned char data[totalbytes];
+        at28c_transfer transfer = checked ? AT28C_BLOCKS : (rle ? AT28C_STREAM_RLE : AT28C_STREAM);
+        int outfd = dumpname != NULL && strcmp(dumpname, "-") == 0 ? rawstdout : -1;
+        if (readEprom(session, romtype, transfer, data, outfd) == -1 || (outfd == -1 && saveEprom(dumpname, data, totalbytes) == -1)) {
+          at28cClose(session);
+          printf("error reading eprom\n");
+          return -1;
+        }
+        shadowStore(&shadow, 0, data, totalbytes);
+      }
+    }
+    // verifica se richiesta identificazione dell'immagine
+    else if (operation == 'i') {
+      if (identifyEprom(session, romtype, filename) == -1) {
+        at28cClose(session);
+        printf("error identifying eprom\n");
         return -1;
       }
-      // attende la risposta contentente il byte letto dalla EPROM
-      char buffer[64];
-      if (readAnswer(fd, buffer, 100) == -1) {
-        close(fd);
-        printf("error reading firmware version\n");
+    }
+    // verifica se richiesta programmazione di uno schema
+    else if (operation == 'f') {
+      int start = address == -1 ? 0 : address;
+      if (length == -1 || start + length > (int)getRomSize(romtype)) {
+        length = getRomSize(romtype) - start;
+      }
+      if (requestFill(session, romtype, start, length, pattern, sdp) == -1) {
+        at28cClose(session);
+        printf("error filling eprom\n");
         return -1;
       }
-      if (memcmp(buffer, "+READBYTE=", 10) == 0) {
-        int val;
-        sscanf(buffer + 10, "%d", &val);
-        unsigned char c = (unsigned char)val;
-        printf("read byte %u [x%02X] at address %u [x%04X]\n", c, c, (unsigned int)address, (unsigned int)address);
+    }
+    // verifica se richiesta ricerca delle temporizzazioni
+    else if (operation == 't') {
+      if (requestTune(session, romtype, address == -1 ? 0 : address, 30000) == -1) {
+        at28cClose(session);
+        printf("error tuning timing\n");
+        return -1;
       }
-    } else {
-      // invia il comando di richiesta lettura della memoria selezionata
-      if (requestRead(fd, romtype) == -1) {
-        close(fd);
-        printf("error request read eprom\n");
+    }
+    // verifica se richiesta verifica del bus
+    else if (operation == 's') {
+      int res = requestSelfTest(session, address == -1 ? 0 : address, 5000);
+      if (res != 0) {
+        at28cClose(session);
+        if (res == -1) {
+          printf("error running self test (requires firmware 0.007)\n");
+        }
         return -1;
       }
-      // legge la risposta con il contenuto della memoria e lo salva su file
-      if (readEprom(fd, romtype, filename, 100) == -1) {
-        close(fd);
+    }
+    // verifica se richiesta scansione dei cicli di scrittura
+    else if (operation == 'h') {
+      size_t totalbytes = getRomSize(romtype);
+      int unit = romtypes[romtype].pagesize > 1 ? romtypes[romtype].pagesize : SCAN_BLOCK_SIZE;
+      int units = totalbytes / unit;
+      unsigned char data[totalbytes];
+      unsigned short test[units];
+      unsigned short restore[units];
+      unsigned char errors[units];
+      // contenuto da ripristinare: immagine indicata o contenuto attuale della memoria
+      if (filename != NULL) {
+        size_t filelen;
+        const unsigned char* base = mapImage(filename, &filelen);
+        if (base == NULL || filelen < totalbytes) {
+          at28cClose(session);
+          if (base != NULL) {
+            munmap((void*)base, filelen);
+            printf("image shorter than eeprom\n");
+          }
+          printf("error scanning eprom\n");
+          return -1;
+        }
+        memcpy(data, base, totalbytes);
+        munmap((void*)base, filelen);
+      } else if (readEprom(session, romtype, AT28C_BLOCKS, data, -1) == -1) {
+        at28cClose(session);
         printf("error reading eprom\n");
         return -1;
       }
+      if (requestScan(session, romtype, sdp, data, test, restore, errors) == -1) {
+        at28cClose(session);
+        printf("error scanning eprom (requires firmware 0.008)\n");
+        return -1;
+      }
+      int res = reportScan(romtype, test, restore, errors, threshold == -1 ? romtypes[romtype].writecycle * 1000L : threshold, csvname);
+      if (res != 0) {
+        at28cClose(session);
+        return -1;
+      }
     }
-  }
-  // verifica se richiesta abilitazione del software data protection
-  else if (operation == 'e') {
-    // invia il comando di richiesta abilitazione del software data protection
-    if (setupSDP(fd, true, 100) == -1) {
-      close(fd);
-      printf("error enabling software data protection\n");
-      return -1;
+    // verifica se richiesta lettura dei contatori diagnostici
+    else if (operation == 'g') {
+      if (requestDiag(session, diagreset, 1000) == -1) {
+        at28cClose(session);
+        printf("error reading diagnostics (requires firmware 0.006)\n");
+        return -1;
+      }
     }
-  }
-  // verifica se richiesta disabilitazione del software data protection
-  else if (operation == 'd') {
-    // invia il comando di richiesta disabilitazione del software data protection
-    if (setupSDP(fd, false, 100) == -1) {
-      close(fd);
-      printf("error disabling software data protection\n");
-      return -1;
+    // verifica se richiesta abilitazione del software data protection
+    else if (operation == 'e') {
+      // invia il comando di richiesta abilitazione del software data protection
+      printf("enable software data protection\n");
+      if (at28cSetSDP(session, true, NULL) == -1 || waitOperation(session) != AT28C_OK) {
+        at28cClose(session);
+        printf("error enabling software data protection\n");
+        return -1;
+      }
+    }
+    // verifica se richiesta disabilitazione del software data protection
+    else if (operation == 'd') {
+      // invia il comando di richiesta disabilitazione del software data protection
+      printf("disable software data protection\n");
+      if (at28cSetSDP(session, false, NULL) == -1 || waitOperation(session) != AT28C_OK) {
+        at28cClose(session);
+        printf("error disabling software data protection\n");
+        return -1;
+      }
+    }
+
+    // le altre operazioni che scrivono la memoria invalidano la copia del contenuto
+    if (strchr("fhtsed", operation) != NULL) {
+      shadowClear(&shadow);
     }
   }
 
-  close(fd);
+  at28cClose(session);
+
+  if (tracefile != NULL) {
+    fclose(tracefile);
+  }
 
   fflush(stdout);
 
   return 0;
 }
 
-// invia il comando di richiesta della versione del firmware
-int requestFirmware(int fd) {
-  const char* cmdGetVersion = "VERSION=?\r";
-  return write(fd, cmdGetVersion, strlen(cmdGetVersion));
-}
 
-// invia il comando di richiesta lettura della memoria
-int requestRead(int fd, e_rom_type romtype) {
-  tcflush(fd, TCIOFLUSH);
 
-  const char* cmdReadAT28C64 = "READEEPROM=8192\r";
-  const char* cmdReadAT28C256 = "READEEPROM=32768\r";
-  if (romtype == AT28C64) {
-    return write(fd, cmdReadAT28C64, strlen(cmdReadAT28C64));
-  } else if (romtype == AT28C256) {
-    return write(fd, cmdReadAT28C256, strlen(cmdReadAT28C256));
-  }
-  return -1;
-}
 
-// invia il comando di richiesta scrittura della memoria
-int requestWrite(int fd, e_rom_type romtype, bool paged) {
-  tcflush(fd, TCIOFLUSH);
 
-  if (romtype == AT28C64) {
-    if (paged) {
-      const char* cmdWrite = "WRITEEEPROM=8192,64\r";
-      return write(fd, cmdWrite, strlen(cmdWrite));
-    } else {
-      const char* cmdWrite = "WRITEEEPROM=8192\r";
-      return write(fd, cmdWrite, strlen(cmdWrite));
-    }
-  } else if (romtype == AT28C256) {
-    if (paged) {
-      const char* cmdWrite = "WRITEEEPROM=32768,64\r";
-      return write(fd, cmdWrite, strlen(cmdWrite));
-    } else {
-      const char* cmdWrite = "WRITEEEPROM=32768\r";
-      return write(fd, cmdWrite, strlen(cmdWrite));
-    }
+
+// invia al programmatore i dati da scrivere leggendoli dall'immagine in memoria, con sdp ogni byte o pagina è preceduto
+// dalla sequenza di sblocco, con rle le pagine vengono trasferite compresse
+// ritorna -1 in caso di errore di comunicazione, 1 se i bytes riletti non corrispondono a quelli scritti
+int writeEprom(at28c_session* session, bool paged, bool sdp, bool rle, int window, const unsigned char* image) {
+  // scrittura a pagine o a byte con window bytes in transito eseguita dalla libreria
+  progress_state progress = { .label = "-> write", .lastperc = -1 };
+  at28c_callbacks callbacks = { onProgress, onMismatch, NULL, &progress };
+  if (at28cWrite(session, image, paged, sdp, rle, window, &callbacks) == -1) {
+    printf("error request write eprom\n");
+    return -1;
   }
-  return -1;
+  int result = waitOperation(session);
+  if (result == AT28C_TIMEOUT) {
+    printf("\nwrite timeout");
+  }
+  printf("\n");
+
+  // visualizza il numero di bytes scritti
+  printf("written: %zu\n", progress.done);
+  if (result == AT28C_MISMATCH) {
+    printf("%zu errors found\n", at28cErrors(session));
+    return 1;
+  }
+  return result == AT28C_OK ? 0 : -1;
 }
 
-// legge e visualizza o salva nel buffer la risposta dal programmatore
-int readAnswer(int fd, char* buffer, long msec) {
-  int readed = 0;
-  while (true) {
-    fd_set rfds;
-    struct timeval tv;
-    int retval;
+// scrive la memoria con l'immagine letta da infd man mano che arriva, calcolando il CRC dei bytes ricevuti
+int writeEpromStream(at28c_session* session, e_rom_type romtype, bool paged, bool sdp, int window, int infd, int fill, unsigned char* image) {
+  size_t totalbytes = getRomSize(romtype);
+  progress_state progress = { .label = "-> write", .lastperc = -1 };
+  at28c_callbacks callbacks = { onProgress, onMismatch, NULL, &progress };
+  if (at28cWriteStream(session, image, paged, sdp, window, &callbacks) == -1) {
+    printf("error request write eprom\n");
+    return -1;
+  }
 
-    FD_ZERO(&rfds);
-    FD_SET(fd, &rfds);
+  // attende insieme l'input e la seriale: i bytes ricevuti vengono resi subito disponibili alla scrittura
+  size_t received = 0;
+  unsigned short crc = 0xFFFF;
+  bool input = true;
+  bool stopping = false;
+  int result;
+  while ((result = at28cStatus(session)) == AT28C_BUSY) {
+    if (cancelled && !stopping) {
+      at28cCancel(session);
+      stopping = true;
+    }
 
-    tv.tv_sec = (msec * 1000) / 1000000;
-    tv.tv_usec = (msec * 1000) % 1000000;
+    struct pollfd fds[2];
+    fds[0].fd = at28cFd(session);
+    fds[0].events = at28cEvents(session);
+    fds[0].revents = 0;
+    fds[1].fd = input && !stopping ? infd : -1;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    long wait = at28cTimeout(session);
+    if (wait == -1 || wait > 100) {
+      wait = 100;
+    }
+    int n = poll(fds, 2, wait);
+    if (n == -1 && errno != EINTR) {
+      printf("error poll\n");
+      at28cCancel(session);
+      stopping = true;
+      continue;
+    }
 
-    retval = select(fd + 1, &rfds, NULL, NULL, &tv);
-    if (retval == -1) {
-      printf("error select\n");
-      return -1;
-    } else if (retval > 0) {
-      // ricevuto risposta legge 1 carattere e lo stampa
-      char c;
-      read(fd, &c, 1);
-      // filtra i caratteri di line feed e carriage return
-      if (c != '\n' && c != '\r') {
-        if (buffer == NULL) {
-          printf("%c", c);
+    if (n > 0 && fds[1].revents) {
+      ssize_t r = read(infd, image + received, totalbytes - received);
+      if (r > 0) {
+        crc = at28cCrc16(crc, image + received, r);
+        received += r;
+      } else if (r == 0 || (errno != EINTR && errno != EAGAIN)) {
+        // fine dell'input: completa l'immagine con il riempimento della vista o interrompe la scrittura
+        if (fill != -1) {
+          memset(image + received, fill, totalbytes - received);
+          crc = at28cCrc16(crc, image + received, totalbytes - received);
+          received = totalbytes;
         } else {
-          buffer[readed] = c;
-          buffer[readed + 1] = 0;
+          printf("\ninput too short: %zu of %zu bytes\n", received, totalbytes);
+          at28cCancel(session);
+          stopping = true;
         }
+        input = false;
+      }
+      // i bytes oltre la dimensione della memoria non vengono letti
+      if (received == totalbytes) {
+        input = false;
+      }
+      // la scrittura parte con STREAM_LEAD_BYTES accumulati o con l'input terminato
+      if (received >= STREAM_LEAD_BYTES || !input) {
+        at28cWriteAvailable(session, received);
       }
-      readed++;
-      // ha ricevuto almeno un carattere,
-      // imposta il timeout per i prossimi caratteri a 100 ms
-      msec = 100;
-    } else {
-      // timeout attesa risposta
-      break;
     }
+    at28cProcess(session, n > 0 ? fds[0].revents : 0);
   }
-
-  // se ha ricevuto dei caratteri solo alla fine visualizza un fine riga
-  if (readed) {
-    if (buffer == NULL) {
-      printf("\n");
-    }
-    return 0;
+  if (result == AT28C_CANCELLED && cancelled) {
+    printf("\ncancelled\n");
+  } else if (result == AT28C_TIMEOUT) {
+    // il programmatore interrompe la scrittura se l'input si ferma oltre il timeout di trasferimento
+    printf(input ? "\nwrite timeout, input stalled (the producer must keep up with the write)" : "\nwrite timeout");
   }
+  printf("\n");
 
-  // se non ha ricevuto risposta ritorna una indicazione di errore
-  return -1;
-}
-
-// legge la risposta dal programmatore con il contenuto della memoria e lo salva sul file indicato, attende la risposta per max msec millisecondi 
-int readEprom(int fd, e_rom_type romtype, char* filename, long msec) {
-  int writefd = -1;
-  int totalbytes = 0;
-  int readed = 0;
-  int lastperc = -1;
-  if (romtype == AT28C64) {
-    totalbytes = 8192;
+  // visualizza il numero di bytes scritti e il CRC dell'immagine ricevuta
+  printf("written: %zu\n", progress.done);
+  if (received == totalbytes) {
+    printf("image crc16: x%04X\n", crc);
   }
-  if (romtype == AT28C256) {
-    totalbytes = 32768;
+  if (result != AT28C_OK && result != AT28C_MISMATCH && progress.done > 0) {
+    printf("eeprom partially written: %zu of %zu bytes, write it again\n", progress.done, totalbytes);
   }
-  if (filename != NULL) {
-    unlink(filename);
-    writefd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    if (writefd == -1) {
-      printf("error opening output file\n");
-      return -1;
-    }
+  if (result == AT28C_MISMATCH) {
+    printf("%zu errors found\n", at28cErrors(session));
+    return 1;
+  }
+  return result == AT28C_OK ? 0 : -1;
+}
+
+// richiede e visualizza i contatori diagnostici del programmatore, con reset li azzera dopo la lettura
+int requestDiag(at28c_session* session, bool reset, long msec) {
+  // una riga +DIAG=<gruppo>,<valori> per gruppo, terminate da +DIAG=END
+  const char* answer = requestAnswer(session, "DIAG=?\r", "+DIAG=", "+DIAG=END", msec);
+  if (answer == NULL) {
+    return -1;
+  }
+
+  char buff[128];
+  bool header = false;
+  while (*answer != 0) {
+    size_t len = strcspn(answer, "\n");
+    snprintf(buff, sizeof(buff), "%.*s", (int)len, answer);
+    answer += answer[len] == '\n' ? len + 1 : len;
+    char* group = buff + 6;
+    if (strcmp(group, "END") == 0) {
+      break;
+    }
+
+    unsigned long a, b, c, d, e;
+    char name[32];
+    if (sscanf(group, "UPTIME,%lu", &a) == 1) {
+      printf("uptime: %.3f s\n", a / 1000.0);
+    } else if (sscanf(group, "LOOP,%lu,%lu", &a, &b) == 2) {
+      printf("idle loop: %lu iterations, max %lu us\n", a, b);
+    } else if (sscanf(group, "SERIAL,%lu,%lu,%lu,%lu,%lu", &a, &b, &c, &d, &e) == 5) {
+      printf("serial: %lu bytes in, %lu bytes out\n", a, b);
+      printf("serial errors: rx buffer full %lu, command overflows %lu, stream timeouts %lu\n", c, d, e);
+    } else if (sscanf(group, "SRAM,%lu,%lu", &a, &b) == 2) {
+      printf("sram: %lu bytes free, %lu bytes minimum\n", a, b);
+    } else if (sscanf(group, "WRITE,%lu,%lu,%lu", &a, &b, &c) == 3) {
+      printf("write cycles: %lu, %lu ms waited (%.2f ms avg), %lu timeouts\n", a, b, a ? (double)b / a : 0.0, c);
+    } else if (sscanf(group, "CMD,%31[^,],%lu,%lu,%lu", name, &a, &b, &c) == 4) {
+      if (!header) {
+        printf("%-12s %8s %12s %10s %10s\n", "command", "count", "total ms", "avg us", "max us");
+        header = true;
+      }
+      // il firmware limita la durata massima a 65535 us
+      char max[16];
+      snprintf(max, sizeof(max), c >= 65535 ? ">%lu" : "%lu", c);
+      printf("%-12s %8lu %12.3f %10lu %10s\n", name, a, b / 1000.0, a ? b / a : 0, max);
+    } else {
+      // gruppi introdotti da versioni successive del firmware
+      printf("%s\n", group);
+    }
+  }
+
+  if (reset) {
+    answer = requestAnswer(session, "DIAG=0\r", "+DIAG=", NULL, msec);
+    if (answer == NULL || strcmp(answer, "+DIAG=0") != 0) {
+      return -1;
+    }
+    printf("diagnostic counters reset\n");
+  }
+  return 0;
+}
+
+// visualizza le linee indicate da una maschera (es. A3 A5), ritorna il numero di linee
+int printLines(char prefix, unsigned int mask) {
+  int lines = 0;
+  for (int i = 0; i < 16; i++) {
+    if (mask & (1 << i)) {
+      printf(" %c%d", prefix, i);
+      lines++;
+    }
+  }
+  return lines;
+}
+
+// verifica walking-bit delle linee di indirizzo e dati sulle locazioni di prova all'indirizzo indicato,
+// ritorna 0 se il bus è integro, 1 con linee bloccate o in corto, -1 in caso di errore
+int requestSelfTest(at28c_session* session, int address, long msec) {
+  const char* cmdSelfTest = "SELFTEST=%d\r";
+  char buff[64];
+  sprintf(buff, cmdSelfTest, address);
+  // la risposta arriva al termine delle scritture di prova e del ripristino
+  const char* answer = requestAnswer(session, buff, "+SELFTEST=", NULL, msec);
+  unsigned int astuck, ashort, dstuck, dshort;
+  if (answer == NULL || sscanf(answer + 10, "%u,%u,%u,%u", &astuck, &ashort, &dstuck, &dshort) != 4) {
+    return -1;
+  }
+
+  if (astuck == 0 && ashort == 0 && dstuck == 0 && dshort == 0) {
+    printf("self test: PASS\n");
+    return 0;
+  }
+  printf("self test: FAIL\n");
+  if (astuck) {
+    printf("address lines stuck:");
+    printLines('A', astuck);
+    printf("\n");
+  }
+  if (ashort) {
+    printf("address lines shorted:");
+    printLines('A', ashort);
+    printf("\n");
+  }
+  if (dstuck) {
+    // tutte le linee dati bloccate: memoria assente o non alimentata
+    printf("data lines stuck:");
+    if (printLines('D', dstuck) == 8) {
+      printf(" (no chip or chip not powered?)");
+    }
+    printf("\n");
+  }
+  if (dshort) {
+    printf("data lines shorted:");
+    printLines('D', dshort);
+    printf("\n");
+  }
+  return 1;
+}
+
+// invia al programmatore la locazione di memoria e il byte da scrivere
+int requestWriteByte(at28c_session* session, int address, unsigned char val, long msec) {
+  const char* cmdWriteByte = "WRITEBYTE=%d,%d\r";
+  char buff[32];
+  sprintf(buff, cmdWriteByte, address, val);
+  printf("write byte %u [x%02X] at address %u [x%04X]\n", (unsigned char)val, (unsigned char)val, (unsigned int)address, (unsigned int)address);
+  const char* answer = requestAnswer(session, buff, "+WRITEBYTE=", NULL, msec);
+  int wval;
+  if (answer == NULL || sscanf(answer + 11, "%d", &wval) != 1) {
+    return -1;
+  }
+  return wval;
+}
+
+// legge al programmatore la locazione di memoria da leggere
+int requestReadByte(at28c_session* session, int address, long msec) {
+  printf("read byte from address %u [x%04X]\n", (unsigned int)address, (unsigned int)address);
+  return readByteValue(session, address, msec);
+}
+
+// restituisce la dimensione in bytes della memoria selezionata
+size_t getRomSize(e_rom_type romtype) {
+  if (romtype == NONE) {
+    return 0;
+  }
+  return romtypes[romtype].size;
+}
+
+// mappa in memoria in sola lettura il file immagine, len riceve la dimensione del file
+const unsigned char* mapImage(char* filename, size_t* len) {
+  int readfd = open(filename, O_RDONLY);
+  if (readfd == -1) {
+    printf("error opening input file\n");
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(readfd, &st) != 0 || st.st_size == 0) {
+    close(readfd);
+    printf("input file empty\n");
+    return NULL;
+  }
+  void* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, readfd, 0);
+  close(readfd);
+  if (base == MAP_FAILED) {
+    printf("error mapping input file\n");
+    return NULL;
+  }
+
+  *len = st.st_size;
+  return base;
+}
+
+// legge un numero di una vista (decimale o preceduto da x per esadecimale)
+bool parseViewNumber(const char* s, size_t* value) {
+  char* end;
+  if (s == NULL || *s == 0) {
+    return false;
+  }
+  *value = s[0] == 'x' ? strtoul(s + 1, &end, 16) : strtoul(s, &end, 10);
+  return *end == 0;
+}
+
+// interpreta la vista (operazioni separate da virgola) per la memoria member del set, filelen è la dimensione del file
+// le operazioni si applicano in ordine alla vista risultante dalle precedenti:
+//   offset:<n>              salta i primi n bytes
+//   length:<n>              limita la vista a n bytes
+//   fill:<byte>             valore dei bytes oltre la lunghezza o la fine del file
+//   interleave:<n>:<lane>   un byte ogni n a partire da lane (lane * = set di n memorie)
+//   bank:<b>[:<size>]       banco b di size bytes (default la dimensione della memoria, b * = tutti i banchi)
+int parseView(char* spec, size_t filelen, size_t chipsize, int member, image_view* view) {
+  view->offset = 0;
+  view->stride = 1;
+  view->length = SIZE_MAX;
+  view->fill = -1;
+  view->setsize = 1;
+  if (spec == NULL) {
+    return 0;
+  }
+
+  char buff[256];
+  if (strlen(spec) >= sizeof(buff)) {
+    return -1;
+  }
+  strcpy(buff, spec);
+  char* save;
+  for (char* op = strtok_r(buff, ",", &save); op != NULL; op = strtok_r(NULL, ",", &save)) {
+    char* args[2] = { NULL, NULL };
+    char* sep = strchr(op, ':');
+    if (sep != NULL) {
+      *sep = 0;
+      args[0] = sep + 1;
+      sep = strchr(args[0], ':');
+      if (sep != NULL) {
+        *sep = 0;
+        args[1] = sep + 1;
+      }
+    }
+
+    size_t n, idx;
+    if (strcmp(op, "offset") == 0 && parseViewNumber(args[0], &n)) {
+      view->offset += n * view->stride;
+      if (view->length != SIZE_MAX) {
+        view->length = view->length > n ? view->length - n : 0;
+      }
+    } else if (strcmp(op, "length") == 0 && parseViewNumber(args[0], &n)) {
+      if (n < view->length) {
+        view->length = n;
+      }
+    } else if (strcmp(op, "fill") == 0 && parseViewNumber(args[0], &n) && n <= 255) {
+      view->fill = n;
+    } else if (strcmp(op, "interleave") == 0 && parseViewNumber(args[0], &n) && n >= 2 && args[1] != NULL) {
+      if (strcmp(args[1], "*") == 0) {
+        // una sola operazione della vista può descrivere il set
+        if (view->setsize != 1) {
+          return -1;
+        }
+        view->setsize = n;
+        idx = member;
+      } else if (!parseViewNumber(args[1], &idx) || idx >= n) {
+        return -1;
+      }
+      view->offset += idx * view->stride;
+      view->stride *= n;
+      if (view->length != SIZE_MAX) {
+        view->length = view->length > idx ? (view->length - idx + n - 1) / n : 0;
+      }
+    } else if (strcmp(op, "bank") == 0 && args[0] != NULL) {
+      size_t size = chipsize;
+      if (args[1] != NULL && (!parseViewNumber(args[1], &size) || size == 0)) {
+        return -1;
+      }
+      if (strcmp(args[0], "*") == 0) {
+        if (view->setsize != 1) {
+          return -1;
+        }
+        // tutti i banchi fino al termine della vista o del file
+        size_t avail = view->length;
+        if (avail == SIZE_MAX) {
+          avail = filelen > view->offset ? (filelen - view->offset + view->stride - 1) / view->stride : 0;
+        }
+        view->setsize = (avail + size - 1) / size;
+        if (view->setsize == 0) {
+          return -1;
+        }
+        idx = member;
+      } else if (!parseViewNumber(args[0], &idx)) {
+        return -1;
+      }
+      view->offset += idx * size * view->stride;
+      size_t remaining = view->length == SIZE_MAX ? SIZE_MAX : (view->length > idx * size ? view->length - idx * size : 0);
+      view->length = remaining < size ? remaining : size;
+    } else {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// restituisce i bytes della vista per una memoria: direttamente dal file mappato se contigui, altrimenti composti in scratch
+const unsigned char* viewData(const unsigned char* base, size_t filelen, image_view* view, size_t chipsize, unsigned char* scratch) {
+  if (view->stride == 1 && view->length >= chipsize && view->offset <= filelen && filelen - view->offset >= chipsize) {
+    return base + view->offset;
+  }
+
+  for (size_t i = 0; i < chipsize; i++) {
+    size_t pos = view->offset + i * view->stride;
+    if (i < view->length && pos < filelen) {
+      scratch[i] = base[pos];
+    } else if (view->fill != -1) {
+      scratch[i] = view->fill;
+    } else {
+      // il file deve contenere almeno il numero di bytes della memoria selezionata
+      printf("input file too short: %zu of %zu bytes\n", i, chipsize);
+      return NULL;
+    }
+  }
+
+  return scratch;
+}
+
+// calcola la firma per il cambio memoria: i primi bytes dell'immagine diversi da una memoria vuota o azzerata,
+// completati con i bytes azzerati
+void imageSignature(const unsigned char* image, size_t len, chip_signature* signature) {
+  signature->count = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t idx = 0; idx < len && signature->count < SWAP_SIGNATURE_BYTES; idx++) {
+      if (pass == 0 ? image[idx] != 0xFF && image[idx] != 0x00 : image[idx] == 0x00) {
+        signature->address[signature->count] = idx;
+        signature->value[signature->count] = image[idx];
+        signature->count++;
+      }
+    }
+  }
+}
+
+// legge i bytes della firma dalla memoria inserita
+int readSignature(at28c_session* session, const chip_signature* signature, int* values) {
+  for (int i = 0; i < signature->count; i++) {
+    values[i] = readByteValue(session, signature->address[i], 100);
+    if (values[i] == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+// richiede al programmatore il CRC16 di un'area della memoria
+int requestChecksum(at28c_session* session, unsigned int start, unsigned int len, unsigned short* crc, long msec) {
+  const char* cmdChecksum = "CHECKSUM=%u,%u\r";
+  char buff[64];
+  sprintf(buff, cmdChecksum, start, len);
+  // la risposta arriva al termine della lettura dell'area richiesta
+  const char* answer = requestAnswer(session, buff, "+CHECKSUM=", NULL, msec);
+  unsigned int val;
+  if (answer == NULL || sscanf(answer + 10, "%u", &val) != 1) {
+    return -1;
+  }
+  *crc = (unsigned short)val;
+  return 0;
+}
+
+// legge il valore del byte alla locazione indicata senza visualizzare messaggi
+int readByteValue(at28c_session* session, int address, long msec) {
+  const char* cmdReadByte = "READBYTE=%d\r";
+  char buff[64];
+  sprintf(buff, cmdReadByte, address);
+  const char* answer = requestAnswer(session, buff, "+READBYTE=", NULL, msec);
+  int val;
+  if (answer == NULL || sscanf(answer + 10, "%d", &val) != 1) {
+    return -1;
+  }
+  return val;
+}
+
+// attende la sostituzione della memoria nello zoccolo o la pressione di invio
+// la memoria programmata è considerata rimossa quando la firma letta cambia e rimane stabile (valore dello zoccolo
+// vuoto), la nuova memoria inserita quando la lettura stabile si discosta da quella dello zoccolo vuoto
+int waitChipSwap(at28c_session* session, const chip_signature* programmed) {
+  bool usestdin = true;
+  bool removed = false;
+  int stable = 0;
+  int last[SWAP_SIGNATURE_BYTES];
+  int empty[SWAP_SIGNATURE_BYTES];
+  size_t size = programmed->count * sizeof(int);
+  memset(last, 0xFF, sizeof(last));
+  if (programmed->count == 0) {
+    printf("blank image, press enter after each swap\n");
   }
-  char buf[128];
-  char bufr[16 + 1];
   while (true) {
     fd_set rfds;
     struct timeval tv;
-    int retval;
 
     FD_ZERO(&rfds);
-    FD_SET(fd, &rfds);
+    if (usestdin) {
+      FD_SET(STDIN_FILENO, &rfds);
+    }
 
-    tv.tv_sec = (msec * 1000) / 1000000;
-    tv.tv_usec = (msec * 1000) % 1000000;
+    // intervallo di polling 50 ms
+    tv.tv_sec = 0;
+    tv.tv_usec = 50000;
 
-    retval = select(fd + 1, &rfds, NULL, NULL, &tv);
+    int retval = select(usestdin ? STDIN_FILENO + 1 : 0, &rfds, NULL, NULL, &tv);
+    if (cancelled) {
+      return -1;
+    }
     if (retval == -1) {
       printf("error select\n");
       return -1;
     } else if (retval > 0) {
-      unsigned char c;
-      read(fd, &c, 1);
-      if (filename != NULL) {
-        write(writefd, &c, 1);
-      } else {
-        if (readed % 16 == 0) {
-          sprintf(buf, "x%04X: ", readed);
+      char line[64];
+      if (fgets(line, sizeof(line), stdin) != NULL) {
+        return 0;
+      }
+      // stdin chiuso, prosegue solo con il rilevamento automatico
+      usestdin = false;
+    }
+    if (programmed->count == 0) {
+      continue;
+    }
+
+    int values[SWAP_SIGNATURE_BYTES];
+    if (readSignature(session, programmed, values) == -1) {
+      printf("error polling chip signature\n");
+      return -1;
+    }
+    if (memcmp(values, last, size) != 0) {
+      memcpy(last, values, size);
+      stable = 0;
+      continue;
+    }
+    stable++;
+    if (!removed) {
+      if (stable >= SWAP_REMOVED_POLLS && memcmp(values, programmed->value, size) != 0) {
+        removed = true;
+        memcpy(empty, values, size);
+        // con il bus a 0xFF una memoria vuota non si distingue dallo zoccolo vuoto
+        bool blank = true;
+        for (int i = 0; i < programmed->count; i++) {
+          blank = blank && values[i] == 0xFF;
+        }
+        if (blank) {
+          printf("empty socket reads as a blank chip, press enter after inserting\n");
         }
-        sprintf(buf + strlen(buf), " x%02X", c);
-        bufr[readed % 16] = c >= 0x20 && c < 0x7F ? c : '.';
       }
-      readed++;
-      if (filename == NULL && readed % 16 == 0) {
-        bufr[16] = 0;
-        sprintf(buf + strlen(buf), "  -  | %s |\n", bufr);
-        printf(buf);
+    } else if (stable >= SWAP_INSERTED_POLLS && memcmp(values, empty, size) != 0) {
+      return 0;
+    }
+  }
+}
+
+// programma in sequenza più memorie con la stessa immagine mantenendo aperta la comunicazione,
+// prima di ogni memoria verifica il bus sulle locazioni all'indirizzo indicato
+int batchWrite(at28c_session* session, e_rom_type romtype, bool paged, bool sdp, bool rle, int window, const unsigned char* image, int count, char* logname, int address) {
+  size_t totalbytes = getRomSize(romtype);
+  unsigned short imagecrc = at28cCrc16(0xFFFF, image, totalbytes);
+
+  // firma per il rilevamento del cambio memoria
+  chip_signature signature;
+  imageSignature(image, totalbytes, &signature);
+
+  FILE* logfile = NULL;
+  if (logname != NULL) {
+    logfile = fopen(logname, "a");
+    if (logfile == NULL) {
+      printf("error opening log file\n");
+      return -1;
+    }
+  }
+
+  int passed = 0;
+  int failed = 0;
+  bool aborted = false;
+  // verifica preliminare del bus prima di ogni memoria, sulle locazioni all'indirizzo indicato
+  // (disattivata con i firmware precedenti alla 0.007 che non la supportano)
+  bool selftest = strcmp(at28cVersion(session), "0.007") >= 0;
+  if (!selftest) {
+    printf("self test not supported by firmware, skipped\n");
+  }
+  // firma attesa nella memoria da sostituire
+  chip_signature expected = signature;
+  for (int chip = 1; (count == 0 || chip <= count) && !cancelled; chip++) {
+    if (chip > 1) {
+      printf("insert chip %d and press enter (or swap chip)\n", chip);
+      fflush(stdout);
+      if (waitChipSwap(session, &expected) == -1) {
+        aborted = true;
+        break;
       }
-      int perc = readed * 100 / totalbytes;
-      if (perc != lastperc) {
-        if (filename != NULL) {
-          printf("<- read percent: %d%%\r", perc);
+    }
+
+    long long start = getMillis();
+    printf("chip %d\n", chip);
+
+    // un contatto difettoso dello zoccolo viene rilevato prima di scrivere l'intera memoria
+    if (selftest) {
+      int test = requestSelfTest(session, address, 5000);
+      if (test == -1) {
+        printf("error request self test\n");
+        aborted = true;
+        break;
+      } else if (test == 1) {
+        failed++;
+        printf("chip %d: FAIL (self test)\n", chip);
+        if (logfile != NULL) {
+          fprintf(logfile, "chip %d: FAIL (self test)\n", chip);
+          fflush(logfile);
+        }
+        // la memoria non è stata programmata: attende la variazione della firma attuale
+        if (readSignature(session, &expected, expected.value) == -1) {
+          aborted = true;
+          break;
         }
-        fflush(stdout);
-        lastperc = perc;
+        continue;
+      }
+    }
+    expected = signature;
+
+    // scrittura dell'immagine precaricata
+    int res = writeEprom(session, paged, sdp, rle, window, image);
+    if (res == -1) {
+      failed++;
+      printf("chip %d: FAIL (write interrupted)\n", chip);
+      if (logfile != NULL) {
+        fprintf(logfile, "chip %d: FAIL (write interrupted)\n", chip);
+        fflush(logfile);
+      }
+      // riallinea il programmatore e prosegue con la memoria successiva
+      if (cancelled || at28cSync(session, false, NULL) == -1 || waitOperation(session) != AT28C_OK) {
+        aborted = true;
+        break;
       }
+      continue;
+    }
+
+    // verifica tramite il CRC16 calcolato dal programmatore
+    unsigned short chipcrc = 0;
+    bool pass = res == 0;
+    if (requestChecksum(session, 0, totalbytes, &chipcrc, 5000) == -1) {
+      printf("error request checksum\n");
+      pass = false;
+    } else if (chipcrc != imagecrc) {
+      printf("checksum mismatch: eprom x%04X, image x%04X\n", chipcrc, imagecrc);
+      pass = false;
+    }
+
+    double secs = (getMillis() - start) / 1000.0;
+    printf("chip %d: %s (%.1f s)\n", chip, pass ? "PASS" : "FAIL", secs);
+    if (logfile != NULL) {
+      fprintf(logfile, "chip %d: %s crc x%04X (%.1f s)\n", chip, pass ? "PASS" : "FAIL", chipcrc, secs);
+      fflush(logfile);
+    }
+    if (pass) {
+      passed++;
     } else {
-      // timeout attesa risposta
-      break;
+      failed++;
     }
   }
 
-  if (filename != NULL && readed) {
-    printf("\n");
+  if (cancelled) {
+    aborted = true;
+  }
+  printf("batch: %d passed, %d failed\n", passed, failed);
+  if (logfile != NULL) {
+    fprintf(logfile, "batch: %d passed, %d failed\n", passed, failed);
+    fclose(logfile);
   }
 
-  // visualizza il numero di bytes ricevuti
-  printf("read: %d\n", readed);
+  return (failed || aborted) ? -1 : 0;
+}
+
+// restituisce un tempo monotono in microsecondi
+long long getMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// registra un record nella traccia
+void traceRecord(char direction, const void* buf, size_t len) {
+  long long now = getMicros();
+  fputc(direction, tracefile);
+  traceWriteVarint(tracefile, now - tracelast);
+  traceWriteVarint(tracefile, len);
+  fwrite(buf, 1, len, tracefile);
+  tracelast = now;
+}
+
+// registra nella traccia il traffico delle operazioni della libreria
+void onTrace(char direction, const void* buf, size_t len, void* user) {
+  (void)user;
+  traceRecord(direction, buf, len);
+}
+
+// visualizza la percentuale di avanzamento di una operazione della libreria
+void onProgress(at28c_session* session, size_t done, size_t total, void* user) {
+  progress_state* progress = user;
+  progress->done = done;
+  if (progress->data != NULL && done > progress->written) {
+    // i bytes completati sono definitivi, vengono inoltrati subito
+    const unsigned char* buf = progress->data + progress->written;
+    size_t len = done - progress->written;
+    progress->crc = at28cCrc16(progress->crc, buf, len);
+    if (write(progress->outfd, buf, len) != (ssize_t)len) {
+      at28cCancel(session);
+    }
+    progress->written = done;
+  }
+  int perc = done * 100 / total;
+  if (perc != progress->lastperc) {
+    printf("%s percent: %d%%\r", progress->label, perc);
+    fflush(stdout);
+    progress->lastperc = perc;
+  }
+}
+
+// visualizza i primi tre bytes riletti diversi dall'immagine
+void onMismatch(at28c_session* session, size_t address, unsigned char expected, unsigned char actual, void* user) {
+  (void)user;
+  if (at28cErrors(session) <= 3) {
+    printf("\n-> address: 0x%04X, expected byte: %u [x%02X], read byte: %u [x%02X]\n", (unsigned int)address, expected, expected, actual, actual);
+  }
+}
+
+// attende il termine dell'operazione avviata sulla sessione, CTRL+C la interrompe riallineando il programmatore
+int waitOperation(at28c_session* session) {
+  bool stopping = false;
+  int result;
+  while ((result = at28cWait(session, 100)) == AT28C_BUSY) {
+    if (cancelled && !stopping) {
+      at28cCancel(session);
+      stopping = true;
+    }
+  }
+  if (result == AT28C_CANCELLED) {
+    printf("\ncancelled\n");
+  }
+  return result;
+}
+
+// invia un comando e attende la risposta che inizia con expected
+const char* requestAnswer(at28c_session* session, const char* cmd, const char* expected, const char* last, long msec) {
+  if (at28cRequest(session, cmd, expected, last, msec, NULL) == -1 || waitOperation(session) != AT28C_OK) {
+    return NULL;
+  }
+  return at28cAnswer(session);
+}
+
+// legge dalla seriale del programmatore registrando i bytes ricevuti nella traccia
+ssize_t serialRead(int fd, void* buf, size_t len) {
+  ssize_t n = read(fd, buf, len);
+  if (n > 0 && tracefile != NULL) {
+    traceRecord(TRACE_FROM_PROGRAMMER, buf, n);
+  }
+  return n;
+}
+
+// scrive sulla seriale del programmatore registrando i bytes inviati nella traccia
+ssize_t serialWrite(int fd, const void* buf, size_t len) {
+  ssize_t n = write(fd, buf, len);
+  if (n > 0 && tracefile != NULL) {
+    traceRecord(TRACE_TO_PROGRAMMER, buf, n);
+  }
+  return n;
+}
+
+// restituisce un tempo monotono in millisecondi
+long long getMillis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// richiede al programmatore il riconoscimento della memoria inserita e dello stato del software data protection
+int requestProbe(at28c_session* session, e_rom_type* romtype, bool* sdpactive, long msec) {
+  const char* answer = requestAnswer(session, "PROBE=?\r", "+PROBE=", NULL, msec);
+  unsigned int size;
+  int sdp;
+  if (answer == NULL || sscanf(answer + 7, "%u,%d", &size, &sdp) != 2) {
+    return -1;
+  }
+  // prima memoria della tabella con la dimensione rilevata, preferendo una memoria con SDP se risulta attivo
+  // (una AT28C64B con SDP disabilitato non è distinguibile da una AT28C64)
+  *romtype = NONE;
+  for (int i = NONE - 1; i >= 0; i--) {
+    if (romtypes[i].size == size && (*romtype == NONE || romtypes[i].sdp == (sdp != 0))) {
+      *romtype = i;
+    }
+  }
+  if (*romtype == NONE) {
+    return -1;
+  }
+  *sdpactive = sdp != 0;
+  return 0;
+}
+
+
+// gestione della richiesta di interruzione (CTRL+C)
+void onInterrupt(int sig) {
+  (void)sig;
+  cancelled = 1;
+}
+
+// verifica se il firmware supporta i trasferimenti compressi RLE
+int requestRLE(at28c_session* session, long msec) {
+  const char* answer = requestAnswer(session, "RLE=?\r", "+RLE=", NULL, msec);
+  if (answer == NULL || strcmp(answer, "+RLE=1") != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+
+
+// richiede la dimensione del buffer di ricezione seriale del firmware
+int requestRxBuffer(at28c_session* session, long msec) {
+  const char* answer = requestAnswer(session, "RXBUFFER=?\r", "+RXBUFFER=", NULL, msec);
+  int size;
+  if (answer == NULL || sscanf(answer + 10, "%d", &size) != 1) {
+    return -1;
+  }
+  return size;
+}
+
+// legge l'intera memoria con il trasferimento indicato, i blocchi corrotti vengono richiesti nuovamente
+int readEprom(at28c_session* session, e_rom_type romtype, at28c_transfer transfer, unsigned char* data, int outfd) {
+  size_t totalbytes = getRomSize(romtype);
+  progress_state progress = { .label = "<- read", .lastperc = -1, .data = outfd != -1 ? data : NULL, .outfd = outfd, .crc = 0xFFFF };
+  at28c_callbacks callbacks = { onProgress, NULL, NULL, &progress };
+  if (at28cRead(session, 0, totalbytes, data, transfer, &callbacks) == -1) {
+    return -1;
+  }
+  int result = waitOperation(session);
+  printf("\n");
+
+  // visualizza il numero di bytes ricevuti correttamente
+  printf("read: %zu\n", progress.done);
+  if (result != AT28C_OK) {
+    if (result == AT28C_ERROR && transfer == AT28C_BLOCKS) {
+      printf("corrupted blocks\n");
+    } else if (result == AT28C_TIMEOUT) {
+      printf("read timeout\n");
+    }
+    return -1;
+  }
+  if (outfd != -1) {
+    printf("image crc16: x%04X\n", progress.crc);
+  }
+
+  return 0;
+}
+
+// apre il file su cui salvare il contenuto letto, - indica lo standard output
+int openOutput(char* filename) {
+  if (strcmp(filename, "-") == 0) {
+    return dup(rawstdout);
+  }
+  unlink(filename);
+  int writefd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (writefd == -1) {
+    printf("error opening output file\n");
+  }
+  return writefd;
+}
+
+// salva il contenuto letto sul file indicato o lo visualizza se non è indicato un file
+int saveEprom(char* filename, unsigned char* data, size_t len) {
   if (filename != NULL) {
+    int writefd = openOutput(filename);
+    if (writefd == -1) {
+      return -1;
+    }
+    if (write(writefd, data, len) != (ssize_t)len) {
+      close(writefd);
+      printf("error writing output file\n");
+      return -1;
+    }
     close(writefd);
+    if (strcmp(filename, "-") == 0) {
+      printf("image crc16: x%04X\n", at28cCrc16(0xFFFF, data, len));
+    }
+    return 0;
   }
 
-  // verifica se ha ricevuto il numero di bytes attesi
-  if (readed != totalbytes) {
+  for (size_t addr = 0; addr < len; addr += 16) {
+    char bufr[16 + 1];
+    printf("x%04zX: ", addr);
+    for (size_t idx = 0; idx < 16; idx++) {
+      unsigned char c = data[addr + idx];
+      printf(" x%02X", c);
+      bufr[idx] = c >= 0x20 && c < 0x7F ? c : '.';
+    }
+    bufr[16] = 0;
+    printf("  -  | %s |\n", bufr);
+  }
+  return 0;
+}
+
+// confronta il contenuto letto con l'immagine
+int compareImage(const unsigned char* image, unsigned char* data, size_t len) {
+  int errors = 0;
+  for (size_t addr = 0; addr < len; addr++) {
+    if (data[addr] != image[addr]) {
+      if (errors < 3) {
+        printf("-> address: 0x%04zX, eprom byte: 0x%02X, image byte: 0x%02X\n", addr, data[addr], image[addr]);
+      }
+      errors++;
+    }
+  }
+
+  // visualizza il numero di bytes verificati
+  printf("verified: %zu\n", len);
+  if (errors) {
+    printf("%d errors found\n", errors);
     return -1;
   }
 
   return 0;
 }
 
-// legge la risposta dal programmatore con il contenuto della memoria e lo verifica con il contenuto del file indicato, attende la risposta per max msec millisecondi 
-int verifyEprom(int fd, e_rom_type romtype, char* filename, long msec) {
-  int totalbytes = 0;
-  int readed = 0;
-  int errors = 0;
-  int lastperc = -1;
-  if (romtype == AT28C64) {
-    totalbytes = 8192;
+// richiede la ricerca del profilo di temporizzazione più veloce, utilizza l'area all'indirizzo indicato come prova
+int requestTune(at28c_session* session, e_rom_type romtype, int address, long msec) {
+  // l'area di prova deve stare nella memoria, oltre la fine le scritture ricadrebbero all'inizio
+  if ((size_t)address + TUNE_SCRATCH_BYTES > getRomSize(romtype)) {
+    printf("scratch area at address %u [x%04X] exceeds the eeprom size\n", (unsigned int)address, (unsigned int)address);
+    return -1;
   }
-  if (romtype == AT28C256) {
-    totalbytes = 32768;
+
+  const char* cmdTune = "TUNE=%d\r";
+  char buff[64];
+  sprintf(buff, cmdTune, address);
+  printf("tuning timing using scratch area at address %u [x%04X]\n", (unsigned int)address, (unsigned int)address);
+  // la ricerca esegue diverse scritture di prova, la risposta arriva al termine
+  const char* answer = requestAnswer(session, buff, "+TUNE=", NULL, msec);
+  if (answer == NULL) {
+    return -1;
   }
-  int readfd = open(filename, O_RDONLY);
-  if (readfd == -1) {
-    printf("error opening input file\n");
+  int setup, access, pulse, hold;
+  if (sscanf(answer + 6, "%d,%d,%d,%d", &setup, &access, &pulse, &hold) != 4) {
+    printf("scratch area test failed with the safe profile\n");
     return -1;
   }
+  printf("timing profile: setup %d us, access %d us, write pulse %d us, hold %d us\n", setup, access, pulse, hold);
+  return 0;
+}
+
+// riceve fino a len bytes dal programmatore visualizzando la percentuale, attende ogni blocco di dati per max msec millisecondi
+// ritorna il numero di bytes ricevuti, -1 in caso di errore o interruzione
+ssize_t receiveData(at28c_session* session, unsigned char* buf, size_t len, long msec) {
+  int fd = at28cFd(session);
+  size_t received = 0;
+  int lastperc = -1;
+  while (received < len) {
+    if (cancelled) {
+      printf("\ncancelled\n");
+      if (at28cSync(session, true, NULL) == 0) {
+        waitOperation(session);
+      }
+      return -1;
+    }
 
-  while (true) {
     fd_set rfds;
     struct timeval tv;
     int retval;
@@ -611,177 +2090,833 @@ int verifyEprom(int fd, e_rom_type romtype, char* filename, long msec) {
     tv.tv_usec = (msec * 1000) % 1000000;
 
     retval = select(fd + 1, &rfds, NULL, NULL, &tv);
-    if (retval == -1) {
+    if (retval == -1 && errno == EINTR) {
+      continue;
+    } else if (retval == -1) {
       printf("error select\n");
       return -1;
-    } else if (retval > 0) {
-      char c;
-      read(fd, &c, 1);
-      char rc;
-      read(readfd, &rc, 1);
-      if (c != rc) {
-          printf("\n-> address: 0x%04X, eprom byte: 0x%02X, file byte: 0x%02X\n", (unsigned int)readed, (unsigned char)c, (unsigned char)rc);
-          errors++;
-      }
-      if (errors >= 3) {
-          printf("\n-> print maximum three errors\r");
-          break;
-      }
-      readed++;
-      int perc = readed * 100 / totalbytes;
-      if (perc != lastperc) {
-        printf("<- verify percent: %d%%\r", perc);
-        fflush(stdout);
-        lastperc = perc;
-      }
-    } else {
-      // timeout attesa risposta
+    } else if (retval == 0) {
+      // timeout attesa risposta, bytes persi
       break;
     }
+    ssize_t n = serialRead(fd, buf + received, len - received);
+    if (n > 0) {
+      received += n;
+    }
+    int perc = received * 100 / len;
+    if (perc != lastperc) {
+      printf("<- read percent: %d%%\r", perc);
+      fflush(stdout);
+      lastperc = perc;
+    }
   }
 
-  if (readed) {
-    printf("\n");
+  return received;
+}
+
+// legge l'intera memoria campionando ogni indirizzo samples volte, salva i valori di maggioranza in data
+// e visualizza gli indirizzi con letture instabili
+// ogni gruppo di 8 indirizzi arriva come: 8 valori, bitmap degli indirizzi instabili
+int readEpromVoted(at28c_session* session, e_rom_type romtype, int samples, unsigned char* data, long msec) {
+  int fd = at28cFd(session);
+  tcflush(fd, TCIOFLUSH);
+
+  size_t totalbytes = getRomSize(romtype);
+  char cmdRead[64];
+  sprintf(cmdRead, "READVOTE=%zu,%d\r", totalbytes, samples);
+  if (serialWrite(fd, cmdRead, strlen(cmdRead)) == -1) {
+    return -1;
+  }
+
+  size_t expected = totalbytes / 8 * 9;
+  unsigned char stream[expected];
+  ssize_t received = receiveData(session, stream, expected, msec);
+  if (received == -1) {
+    return -1;
+  }
+  printf("\n");
+
+  // interpreta solo i gruppi ricevuti completi
+  int weak = 0;
+  size_t groups = (size_t)received / 9;
+  for (size_t group = 0; group < groups; group++) {
+    unsigned char* frame = stream + group * 9;
+    memcpy(data + group * 8, frame, 8);
+    for (int idx = 0; idx < 8; idx++) {
+      if (frame[8] & (1 << idx)) {
+        // visualizza al massimo 256 celle instabili
+        if (weak < 256) {
+          printf("weak cell: address 0x%04zX, majority byte 0x%02X\n", group * 8 + idx, frame[idx]);
+        }
+        weak++;
+      }
+    }
   }
 
   // visualizza il numero di bytes ricevuti
-  printf("verified: %d\n", readed);
-  close(readfd);
+  printf("read: %zu\n", groups * 8);
+  if (weak) {
+    printf("%d weak cells found (%d samples per address)\n", weak, samples);
+  }
 
   // verifica se ha ricevuto il numero di bytes attesi
-  if (readed != totalbytes) {
+  if ((size_t)received != expected) {
     return -1;
   }
 
-  if (errors) {
-    printf("%d errors found\n", errors);
+  return 0;
+}
+
+// verifica lo schema di programmazione (ADDR, ADDRX o fino a 8 bytes esadecimali) e lo converte in maiuscolo
+int checkFillPattern(char* pattern) {
+  for (char* p = pattern; *p; p++) {
+    *p = toupper((unsigned char)*p);
+  }
+  if (strcmp(pattern, "ADDR") == 0 || strcmp(pattern, "ADDRX") == 0) {
+    return 0;
+  }
+  size_t len = strlen(pattern);
+  if (len == 0 || len % 2 != 0 || len > 16 || strspn(pattern, "0123456789ABCDEF") != len) {
     return -1;
   }
-
   return 0;
 }
 
-// invia al prorammatore i dati da scrivere leggendoli dal file indicato, per ogni byte attende al massimo msecforbyte millisecondi
-int writeEprom(int fd, e_rom_type romtype, bool paged, char* filename, long msecforbyte) {
-  size_t totalbytes = 0;
-  size_t written = 0;
-  int lastperc = -1;
-  if (romtype == AT28C64) {
-    totalbytes = 8192;
+// programma un'area della memoria con uno schema generato dal programmatore, senza trasferire i dati
+int requestFill(at28c_session* session, e_rom_type romtype, int start, int len, char* pattern, bool sdp) {
+  char buff[64];
+  sprintf(buff, "FILL=%d,%d,%s,%d\r", start, len, pattern, sdp);
+  printf("filling %d bytes at address %u [x%04X] with %s\n", len, (unsigned int)start, (unsigned int)start, pattern);
+
+  // la risposta arriva al termine della programmazione: attende il tempo di scrittura massimo di ogni pagina
+  // e il tempo di bus di ogni byte
+  int pagesize = romtypes[romtype].pagesize;
+  long msec = (long)((len + pagesize - 1) / pagesize + 1) * (romtypes[romtype].writecycle * 2 + 5) +
+              (long)len * FILL_BYTE_US / 1000 + 1000;
+  if (at28cRequest(session, buff, "+FILL=", NULL, msec, NULL) == -1) {
+    return -1;
   }
-  if (romtype == AT28C256) {
-    totalbytes = 32768;
+  // CTRL+C interrompe la programmazione al termine della pagina in corso e riallinea il programmatore, allo scadere
+  // del timeout il firmware potrebbe essere ancora in programmazione: viene interrotto e riallineato
+  int result = waitOperation(session);
+  if (result == AT28C_TIMEOUT) {
+    printf("fill timeout\n");
+    if (at28cSync(session, true, NULL) == 0) {
+      waitOperation(session);
+    }
   }
-  int readfd = open(filename, O_RDONLY);
-  if (readfd == -1) {
-    printf("error opening input file\n");
+  if (result != AT28C_OK) {
+    return -1;
+  }
+
+  const char* answer = at28cAnswer(session);
+  if (strcmp(answer, "+FILL=ABORT") == 0) {
+    printf("fill aborted\n");
+    return -1;
+  }
+  unsigned int errors;
+  if (sscanf(answer + 6, "%u", &errors) != 1) {
+    return -1;
+  }
+  if (errors > 0) {
+    printf("fill error, %u bytes not verified\n", errors);
+    return -1;
+  }
+  printf("filled: %d\n", len);
+  return 0;
+}
+
+// misura i cicli di scrittura dell'intera memoria, per pagina o per blocco di SCAN_BLOCK_SIZE bytes: ogni blocco
+// viene scritto con il complemento di original e ripristinato, salva le durate (us) e i bytes non verificati
+int requestScan(at28c_session* session, e_rom_type romtype, bool sdp, const unsigned char* original, unsigned short* test, unsigned short* restore, unsigned char* errors) {
+  int fd = at28cFd(session);
+  tcflush(fd, TCIOFLUSH);
+
+  size_t totalbytes = getRomSize(romtype);
+  int pagesize = romtypes[romtype].pagesize;
+  int unit = pagesize > 1 ? pagesize : SCAN_BLOCK_SIZE;
+  int units = totalbytes / unit;
+
+  char buff[64];
+  sprintf(buff, "SCAN=%zu,%d\r", totalbytes, sdp);
+  if (serialWrite(fd, buff, strlen(buff)) == -1) {
     return -1;
   }
-  char c;
-  size_t blocksize = paged ? 64 : 1;
-  unsigned char buf[blocksize];
-  while (read(readfd, buf, blocksize) == blocksize) {
-    write(fd, buf, blocksize);
 
-    size_t recvd = 0;
-    unsigned char rbuf[blocksize];
-    while (recvd < blocksize) {
+  // due scritture per blocco (prova e ripristino), ciascuna attesa dal firmware al massimo 2 tWC per ciclo
+  int cycles = pagesize > 1 ? 1 : unit;
+  long msec = (long)cycles * 2 * romtypes[romtype].writecycle * 2 + 1000;
+  int lastperc = -1;
+  for (int idx = 0; idx < units; idx++) {
+    if (cancelled) {
+      // il firmware interrompe la scansione allo scadere del timeout del trasferimento
+      printf("\ncancelled\n");
+      if (at28cSync(session, true, NULL) == 0) {
+        waitOperation(session);
+      }
+      return -1;
+    }
+
+    // invia il contenuto originale del blocco e attende durate e bytes non verificati,
+    // da qui il blocco può contenere il complemento fino alla ricezione del risultato
+    if (serialWrite(fd, original + idx * unit, unit) == -1) {
+      restoreScanBlock(session, romtype, sdp, original, idx * unit, unit);
+      return -1;
+    }
+    unsigned char result[5];
+    size_t received = 0;
+    while (received < sizeof(result)) {
       fd_set rfds;
       struct timeval tv;
-      int retval;
 
       FD_ZERO(&rfds);
       FD_SET(fd, &rfds);
 
-      tv.tv_sec = (msecforbyte * 1000) / 1000000;
-      tv.tv_usec = (msecforbyte * 1000) % 1000000;
+      tv.tv_sec = (msec * 1000) / 1000000;
+      tv.tv_usec = (msec * 1000) % 1000000;
 
-      retval = select(fd + 1, &rfds, NULL, NULL, &tv);
-      if (retval == -1) {
+      int retval = select(fd + 1, &rfds, NULL, NULL, &tv);
+      if (retval == -1 && errno == EINTR) {
+        continue;
+      } else if (retval == -1) {
         printf("error select\n");
+        restoreScanBlock(session, romtype, sdp, original, idx * unit, unit);
         return -1;
-      } else if (retval > 0) {
-        char rc;
-        recvd += read(fd, rbuf + recvd, blocksize - recvd);
-      } else {
-        // timeout attesa risposta scrittura byte
-        printf("write timeout\n");
-        break;
+      } else if (retval == 0) {
+        printf("\ntimeout scanning block %d\n", idx);
+        restoreScanBlock(session, romtype, sdp, original, idx * unit, unit);
+        return -1;
+      }
+      ssize_t n = serialRead(fd, result + received, sizeof(result) - received);
+      if (n > 0) {
+        received += n;
+      }
+    }
+    test[idx] = (result[0] << 8) | result[1];
+    restore[idx] = (result[2] << 8) | result[3];
+    errors[idx] = result[4];
+
+    int perc = (idx + 1) * 100 / units;
+    if (perc != lastperc) {
+      printf("-> scan percent: %d%%\r", perc);
+      fflush(stdout);
+      lastperc = perc;
+    }
+  }
+  printf("\n");
+
+  return 0;
+}
+
+// riscrive con il contenuto originale il blocco di len bytes all'indirizzo indicato di una scansione interrotta,
+// se non riesce salva l'intero contenuto originale nel file di recupero
+int restoreScanBlock(at28c_session* session, e_rom_type romtype, bool sdp, const unsigned char* original, int address, int len) {
+  printf("restoring block at address %u [x%04X]\n", (unsigned int)address, (unsigned int)address);
+
+  // il firmware abbandona la scansione allo scadere del timeout del trasferimento, poi il blocco
+  // viene riscritto a gruppi di 8 bytes (lunghezza massima dello schema di FILL)
+  int res = at28cSync(session, true, NULL) == 0 && waitOperation(session) == AT28C_OK ? 0 : -1;
+  for (int pos = 0; pos < len && res == 0; pos += 8) {
+    char pattern[2 * 8 + 1];
+    int n = len - pos < 8 ? len - pos : 8;
+    for (int idx = 0; idx < n; idx++) {
+      sprintf(pattern + idx * 2, "%02X", original[address + pos + idx]);
+    }
+    res = requestFill(session, romtype, address + pos, n, pattern, sdp);
+  }
+  if (res == 0) {
+    return 0;
+  }
+
+  char* filename = SCAN_BACKUP_FILENAME;
+  char cwd[PATH_MAX];
+  if (saveEprom(filename, (unsigned char*)original, getRomSize(romtype)) == -1) {
+    printf("error restoring block, the original contents could not be saved\n");
+  } else {
+    printf("error restoring block, original contents saved to %s/%s (write them back with -o w)\n",
+           getcwd(cwd, sizeof(cwd)) != NULL ? cwd : ".", filename);
+  }
+  return -1;
+}
+
+// visualizza la mappa dei cicli di scrittura e le statistiche, salva i risultati per blocco nel file CSV se indicato
+// ritorna 0 se la memoria è accettata (nessun errore e durate entro threshold us), 1 se scartata, -1 in caso di errore
+int reportScan(e_rom_type romtype, const unsigned short* test, const unsigned short* restore, const unsigned char* errors, long threshold, char* csvname) {
+  int unit = romtypes[romtype].pagesize > 1 ? romtypes[romtype].pagesize : SCAN_BLOCK_SIZE;
+  int units = getRomSize(romtype) / unit;
+  int levels = strlen(SCAN_MAP_LEVELS);
+
+  // mappa: un simbolo per blocco con la durata peggiore tra scrittura di prova e ripristino
+  printf("write cycle map (%d bytes per block, %d blocks per row):\n", unit, SCAN_MAP_COLUMNS);
+  for (int idx = 0; idx < units; idx++) {
+    if (idx % SCAN_MAP_COLUMNS == 0) {
+      printf("x%04X ", (unsigned int)(idx * unit));
+    }
+    long worst = test[idx] > restore[idx] ? test[idx] : restore[idx];
+    char sym;
+    if (errors[idx] > 0) {
+      sym = 'X';
+    } else if (worst == SCAN_TIMEOUT_US) {
+      sym = 'T';
+    } else if (worst > threshold) {
+      sym = '!';
+    } else {
+      sym = SCAN_MAP_LEVELS[worst * levels / (threshold + 1)];
+    }
+    putchar(sym);
+    if (idx % SCAN_MAP_COLUMNS == SCAN_MAP_COLUMNS - 1 || idx == units - 1) {
+      putchar('\n');
+    }
+  }
+  printf("legend: %s up to %ld us, ! slower, T not completed, X verify errors\n", SCAN_MAP_LEVELS, threshold);
+
+  // statistiche delle durate completate e blocchi fuori soglia
+  long mintime = -1, maxtime = 0, sumtest = 0, sumrestore = 0;
+  int measured = 0, slow = 0, timeouts = 0, failed = 0, slowest = 0;
+  for (int idx = 0; idx < units; idx++) {
+    long worst = test[idx] > restore[idx] ? test[idx] : restore[idx];
+    if (errors[idx] > 0) {
+      failed++;
+    }
+    if (worst == SCAN_TIMEOUT_US) {
+      timeouts++;
+      continue;
+    }
+    if (worst > threshold) {
+      slow++;
+    }
+    if (mintime == -1 || worst < mintime) {
+      mintime = worst;
+    }
+    if (worst > maxtime) {
+      maxtime = worst;
+      slowest = idx;
+    }
+    sumtest += test[idx];
+    sumrestore += restore[idx];
+    measured++;
+  }
+  if (measured > 0) {
+    printf("write cycle: min %ld us, max %ld us (block at x%04X), avg test %ld us, avg restore %ld us\n",
+           mintime, maxtime, (unsigned int)(slowest * unit), sumtest / measured, sumrestore / measured);
+  }
+  printf("blocks: %d, slow: %d, not completed: %d, verify errors: %d\n", units, slow, timeouts, failed);
+
+  if (csvname != NULL) {
+    FILE* csv = fopen(csvname, "w");
+    if (csv == NULL) {
+      printf("error opening csv file\n");
+      return -1;
+    }
+    fprintf(csv, "block,address,test_us,restore_us,errors\n");
+    for (int idx = 0; idx < units; idx++) {
+      fprintf(csv, "%d,%d,%u,%u,%u\n", idx, idx * unit, test[idx], restore[idx], errors[idx]);
+    }
+    fclose(csv);
+  }
+
+  if (slow > 0 || timeouts > 0 || failed > 0) {
+    printf("chip REJECTED (threshold %ld us)\n", threshold);
+    return 1;
+  }
+  printf("chip ACCEPTED (threshold %ld us)\n", threshold);
+  return 0;
+}
+
+// converte una cifra esadecimale, -1 se non valida
+int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// carica un'immagine binaria (.bin) o Intel HEX (.hex), size riceve la dimensione dell'immagine
+// (nei file Intel HEX le locazioni non definite valgono 0xFF, la dimensione arriva all'ultimo indirizzo definito)
+int loadIndexImage(const char* filename, unsigned char* data, size_t* size) {
+  FILE* f = fopen(filename, "rb");
+  if (f == NULL) {
+    return -1;
+  }
+
+  size_t namelen = strlen(filename);
+  if (namelen < 4 || strcasecmp(filename + namelen - 4, ".hex") != 0) {
+    *size = fread(data, 1, INDEX_MAX_SIZE, f);
+    // i file più grandi della memoria più grande non sono immagini di una AT28C
+    bool toolarge = fgetc(f) != EOF;
+    fclose(f);
+    return *size == 0 || toolarge ? -1 : 0;
+  }
+
+  memset(data, 0xFF, INDEX_MAX_SIZE);
+  *size = 0;
+  unsigned long base = 0;
+  char line[600];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] != ':') {
+      continue;
+    }
+    // decodifica il record: lunghezza, indirizzo, tipo, dati, checksum
+    unsigned char rec[256 + 5];
+    int n = 0;
+    for (char* p = line + 1; hexDigit(p[0]) != -1 && hexDigit(p[1]) != -1 && n < (int)sizeof(rec); p += 2) {
+      rec[n++] = hexDigit(p[0]) << 4 | hexDigit(p[1]);
+    }
+    if (n < 5 || n != rec[0] + 5) {
+      fclose(f);
+      return -1;
+    }
+    unsigned char sum = 0;
+    for (int i = 0; i < n; i++) {
+      sum += rec[i];
+    }
+    if (sum != 0) {
+      fclose(f);
+      return -1;
+    }
+
+    unsigned int offset = rec[1] << 8 | rec[2];
+    if (rec[3] == 0x00) {
+      // dati
+      for (int i = 0; i < rec[0]; i++) {
+        unsigned long addr = base + offset + i;
+        if (addr >= INDEX_MAX_SIZE) {
+          fclose(f);
+          return -1;
+        }
+        data[addr] = rec[4 + i];
+        if (addr + 1 > *size) {
+          *size = addr + 1;
+        }
       }
+    } else if (rec[3] == 0x01) {
+      // fine file
+      break;
+    } else if (rec[3] == 0x02 && rec[0] == 2) {
+      // indirizzo di segmento esteso
+      base = (unsigned long)(rec[4] << 8 | rec[5]) << 4;
+    } else if (rec[3] == 0x04 && rec[0] == 2) {
+      // indirizzo lineare esteso
+      base = (unsigned long)(rec[4] << 8 | rec[5]) << 16;
     }
+  }
+  fclose(f);
+
+  return *size == 0 ? -1 : 0;
+}
+
+// calcola i CRC dell'immagine e dei blocchi di una voce dell'indice
+void indexImage(image_entry* entry, unsigned char* data, size_t size) {
+  entry->size = size;
+  entry->crc = at28cCrc16(0xFFFF, data, size);
+  entry->blocks = (size + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+  memset(data + size, 0xFF, entry->blocks * INDEX_BLOCK_SIZE - size);
+  for (int b = 0; b < entry->blocks; b++) {
+    entry->blockcrc[b] = at28cCrc16(0xFFFF, data + b * INDEX_BLOCK_SIZE, INDEX_BLOCK_SIZE);
+  }
+}
 
-    bool err = false;
-    for (size_t idx = 0; idx < blocksize; idx++) {
-      if (rbuf[idx] != buf[idx]) {
-        printf("\n-> written byte: %u [x%02X], read byte: %u [x%02X]\n", buf[idx], buf[idx], rbuf[idx], rbuf[idx]);
-        err = true;
+// aggiorna l'indice delle immagini presenti nella directory, ricalcolando solo i file nuovi o modificati
+int updateImageIndex(const char* dirname, image_entry** entries, int* count) {
+  char path[4096];
+
+  // carica l'indice salvato: nome, dimensione e data del file, dimensione e CRC dell'immagine, CRC dei blocchi
+  int saved = 0;
+  image_entry* old = NULL;
+  snprintf(path, sizeof(path), "%s/%s", dirname, INDEX_FILENAME);
+  FILE* f = fopen(path, "r");
+  if (f != NULL) {
+    char* line = NULL;
+    size_t linesize = 0;
+    while (getline(&line, &linesize, f) != -1) {
+      if (line[0] == '#') {
+        continue;
+      }
+      image_entry e;
+      char* fields[7];
+      int nfields = 0;
+      char* save;
+      for (char* tok = strtok_r(line, "\t\n", &save); tok != NULL && nfields < 7; tok = strtok_r(NULL, "\t\n", &save)) {
+        fields[nfields++] = tok;
+      }
+      if (nfields != 7 || atoi(fields[5]) != INDEX_BLOCK_SIZE || strlen(fields[0]) >= sizeof(e.name)) {
+        continue;
+      }
+      strcpy(e.name, fields[0]);
+      e.filesize = atoll(fields[1]);
+      e.mtime = atoll(fields[2]);
+      e.size = strtoul(fields[3], NULL, 10);
+      e.crc = strtoul(fields[4], NULL, 16);
+      e.blocks = 0;
+      for (char* tok = strtok_r(fields[6], ",", &save); tok != NULL && e.blocks < INDEX_MAX_SIZE / INDEX_BLOCK_SIZE;
+           tok = strtok_r(NULL, ",", &save)) {
+        e.blockcrc[e.blocks++] = strtoul(tok, NULL, 16);
+      }
+      if (e.blocks != (int)((e.size + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE)) {
+        continue;
+      }
+      image_entry* grown = realloc(old, (saved + 1) * sizeof(image_entry));
+      if (grown == NULL) {
         break;
       }
+      old = grown;
+      old[saved++] = e;
+    }
+    free(line);
+    fclose(f);
+  }
+
+  DIR* dir = opendir(dirname);
+  if (dir == NULL) {
+    printf("error opening image directory\n");
+    free(old);
+    return -1;
+  }
+
+  *entries = NULL;
+  *count = 0;
+  int updated = 0;
+  struct dirent* de;
+  while ((de = readdir(dir)) != NULL) {
+    size_t namelen = strlen(de->d_name);
+    if (namelen < 5 || namelen >= sizeof(old->name) ||
+        (strcasecmp(de->d_name + namelen - 4, ".bin") != 0 && strcasecmp(de->d_name + namelen - 4, ".hex") != 0)) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dirname, de->d_name);
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
     }
 
-    if (err) {
+    image_entry* grown = realloc(*entries, (*count + 1) * sizeof(image_entry));
+    if (grown == NULL) {
       break;
     }
+    *entries = grown;
+    image_entry* entry = &(*entries)[*count];
+
+    // riutilizza la voce salvata se il file non è cambiato
+    int found = -1;
+    for (int i = 0; i < saved; i++) {
+      if (strcmp(old[i].name, de->d_name) == 0 && old[i].filesize == st.st_size && old[i].mtime == st.st_mtime) {
+        found = i;
+        break;
+      }
+    }
+    if (found != -1) {
+      *entry = old[found];
+    } else {
+      unsigned char data[INDEX_MAX_SIZE];
+      size_t size;
+      if (loadIndexImage(path, data, &size) == -1) {
+        printf("skipped %s: not an eeprom image\n", de->d_name);
+        continue;
+      }
+      strcpy(entry->name, de->d_name);
+      entry->filesize = st.st_size;
+      entry->mtime = st.st_mtime;
+      indexImage(entry, data, size);
+      updated++;
+    }
+    (*count)++;
+  }
+  closedir(dir);
+
+  // salva l'indice se è cambiato (file nuovi, modificati o rimossi)
+  if (updated > 0 || *count != saved) {
+    snprintf(path, sizeof(path), "%s/%s", dirname, INDEX_FILENAME);
+    f = fopen(path, "w");
+    if (f == NULL) {
+      printf("warning: unable to save image index\n");
+    } else {
+      fprintf(f, "# AT28C image index: name, file size, mtime, image size, crc16, block size, block crc16\n");
+      for (int i = 0; i < *count; i++) {
+        image_entry* entry = &(*entries)[i];
+        fprintf(f, "%s\t%lld\t%lld\t%zu\t%04X\t%d\t", entry->name, entry->filesize, entry->mtime, entry->size, entry->crc, INDEX_BLOCK_SIZE);
+        for (int b = 0; b < entry->blocks; b++) {
+          fprintf(f, b ? ",%04X" : "%04X", entry->blockcrc[b]);
+        }
+        fprintf(f, "\n");
+      }
+      fclose(f);
+    }
+  }
+  printf("image index: %d images (%d updated)\n", *count, updated);
 
-    written += blocksize;
-    int perc = written * 100 / totalbytes;
-    if (perc != lastperc) {
-      printf("-> write percent: %d%%\r", perc);
-      fflush(stdout);
-      lastperc = perc;
+  free(old);
+  return 0;
+}
+
+// richiede al programmatore i CRC16 dei blocchi di un'area della memoria
+int requestBlockSums(at28c_session* session, size_t start, size_t len, int blocksize, unsigned short* crcs, long msec) {
+  char cmdSums[64];
+  sprintf(cmdSums, "BLOCKSUMS=%zu,%zu,%d\r", start, len, blocksize);
+
+  // la riga viene inviata man mano che il programmatore calcola i blocchi
+  int blocks = (len + blocksize - 1) / blocksize;
+  const char* answer = requestAnswer(session, cmdSums, "+BLOCKSUMS=", NULL, msec);
+  if (answer == NULL) {
+    return -1;
+  }
+  char* buff = strdup(answer);
+  if (buff == NULL) {
+    return -1;
+  }
+  int n = 0;
+  char* save;
+  for (char* tok = strtok_r(buff + 11, ",", &save); tok != NULL && n < blocks; tok = strtok_r(NULL, ",", &save)) {
+    crcs[n++] = strtoul(tok, NULL, 16);
+  }
+  free(buff);
+
+  return n == blocks ? 0 : -1;
+}
+
+// identifica l'immagine presente nella memoria confrontando i CRC dei blocchi con l'indice della directory
+int identifyEprom(at28c_session* session, e_rom_type romtype, char* dirname) {
+  image_entry* entries;
+  int count;
+  if (updateImageIndex(dirname, &entries, &count) == -1) {
+    return -1;
+  }
+
+  // trasferisce solo i CRC dei blocchi, la memoria viene letta dal programmatore
+  size_t totalbytes = getRomSize(romtype);
+  int blocks = totalbytes / INDEX_BLOCK_SIZE;
+  unsigned short crcs[INDEX_MAX_SIZE / INDEX_BLOCK_SIZE];
+  long long started = getMillis();
+  if (requestBlockSums(session, 0, totalbytes, INDEX_BLOCK_SIZE, crcs, 1000) == -1) {
+    free(entries);
+    return -1;
+  }
+  printf("block checksums: %d blocks in %lld ms\n", blocks, getMillis() - started);
+
+  // l'immagine più vicina è quella con meno blocchi diversi (le immagini più piccole della memoria
+  // vengono confrontate con la parte iniziale)
+  int best = -1;
+  int bestdiff = 0;
+  for (int i = 0; i < count; i++) {
+    if (entries[i].size > totalbytes) {
+      continue;
+    }
+    int diff = 0;
+    for (int b = 0; b < entries[i].blocks; b++) {
+      if (entries[i].blockcrc[b] != crcs[b]) {
+        diff++;
+      }
+    }
+    if (best == -1 || diff < bestdiff || (diff == bestdiff && entries[i].size > entries[best].size)) {
+      best = i;
+      bestdiff = diff;
     }
   }
 
-  if (written) {
-    printf("\n");
+  if (best == -1) {
+    printf("no known image fits the eeprom\n");
+    free(entries);
+    return 0;
   }
 
-  // visualizza il numero di bytes scritti
-  printf("written: %d\n", written);
-  close(readfd);
+  image_entry* entry = &entries[best];
+  if (bestdiff == 0) {
+    printf("matching image: %s (crc16 %04X", entry->name, entry->crc);
+    if (entry->size < totalbytes) {
+      printf(", first %zu bytes", entry->size);
+    }
+    printf(")\n");
+  } else {
+    printf("closest image: %s, %d of %d blocks differ\n", entry->name, bestdiff, entry->blocks);
+    // visualizza le aree diverse raggruppando i blocchi consecutivi
+    int ranges = 0;
+    for (int b = 0; b < entry->blocks; b++) {
+      if (entry->blockcrc[b] == crcs[b]) {
+        continue;
+      }
+      int first = b;
+      while (b + 1 < entry->blocks && entry->blockcrc[b + 1] != crcs[b + 1]) {
+        b++;
+      }
+      if (ranges++ < 16) {
+        printf("  differs x%04X-x%04X\n", first * INDEX_BLOCK_SIZE, (b + 1) * INDEX_BLOCK_SIZE - 1);
+      }
+    }
+    if (ranges > 16) {
+      printf("  ... %d more areas\n", ranges - 16);
+    }
+  }
+
+  free(entries);
+  return 0;
+}
 
-  // verifica se ha scritto il numero di bytes attesi
-  if (written != totalbytes) {
+// interpreta una operazione della sequenza (es. wps), ritorna -1 se sconosciuta
+int parseOperation(const char* spec, op_step* step) {
+  memset(step, 0, sizeof(op_step));
+  snprintf(step->spec, sizeof(step->spec), "%s", spec);
+  // modificatori ammessi dall'operazione, indicati dopo la lettera dell'operazione in qualsiasi ordine
+  const char* modifiers = "";
+  // opzione per la scrittura della memoria
+  if (spec[0] == 'w') {
+    step->operation = 'w';
+    // p = scrittura della memoria paginata, s = con software data protection attivo, b = scrittura di un byte
+    modifiers = "psb";
+  // opzione per la verifica della memoria
+  } else if (spec[0] == 'v') {
+    step->operation = 'v';
+  // opzione per la lettura della memoria
+  } else if (spec[0] == 'r') {
+    step->operation = 'r';
+    // b = lettura di un byte
+    modifiers = "b";
+  // opzione per l'abilitazione del software data protection
+  } else if (spec[0] == 'e') {
+    step->operation = 'e';
+  // opzione per la disabilitazione del software data protection
+  } else if (spec[0] == 'd') {
+    step->operation = 'd';
+  // opzione per il riconoscimento della memoria
+  } else if (spec[0] == 'p') {
+    step->operation = 'p';
+  // opzione per la ricerca delle temporizzazioni
+  } else if (spec[0] == 't') {
+    step->operation = 't';
+  // opzione per l'identificazione dell'immagine presente
+  } else if (spec[0] == 'i') {
+    step->operation = 'i';
+  // opzione per la verifica del bus
+  } else if (spec[0] == 's') {
+    step->operation = 's';
+  // opzione per la scansione dei cicli di scrittura
+  } else if (spec[0] == 'h') {
+    step->operation = 'h';
+    // s = scansione con software data protection attivo
+    modifiers = "s";
+  // opzione per la lettura dei contatori diagnostici
+  } else if (spec[0] == 'g') {
+    step->operation = 'g';
+    // r = azzeramento dei contatori dopo la lettura
+    modifiers = "r";
+  // opzione per la programmazione di uno schema
+  } else if (spec[0] == 'f') {
+    step->operation = 'f';
+    // s = programmazione con software data protection attivo
+    modifiers = "s";
+  } else {
     return -1;
   }
 
+  for (const char* m = spec + 1; *m != 0; m++) {
+    if (strchr(modifiers, *m) == NULL) {
+      return -1;
+    }
+    if (*m == 'p') {
+      step->paged = true;
+    } else if (*m == 's') {
+      step->sdp = true;
+    } else if (*m == 'b') {
+      step->singlebyte = true;
+    } else if (*m == 'r') {
+      step->diagreset = true;
+    }
+  }
   return 0;
 }
 
-// setup Software Data Protection
-int setupSDP(int fd, bool enable, long msec) {
-  tcflush(fd, TCIOFLUSH);
+// segna come noti i blocchi dell'area indicata (start e len multipli di SHADOW_BLOCK_SIZE) copiandone il contenuto
+void shadowStore(shadow_image* shadow, size_t start, const unsigned char* data, size_t len) {
+  memcpy(shadow->data + start, data, len);
+  for (size_t addr = start; addr < start + len; addr += SHADOW_BLOCK_SIZE) {
+    shadow->known[addr / SHADOW_BLOCK_SIZE] = true;
+  }
+}
 
-  const char* cmdEnableSDP = "ENABLESDP=1\r";
-  const char* cmdDisableSDP = "ENABLESDP=0\r";
-  if (enable) {
-    printf("enable software data protection\n");
-    return write(fd, cmdEnableSDP, strlen(cmdEnableSDP));
-  } else {
-    printf("disable software data protection\n");
-    return write(fd, cmdDisableSDP, strlen(cmdDisableSDP));
+// invalida l'intera copia del contenuto della memoria
+void shadowClear(shadow_image* shadow) {
+  memset(shadow->known, 0, sizeof(shadow->known));
+}
+
+// numero di bytes noti della copia del contenuto della memoria
+size_t shadowKnown(const shadow_image* shadow, size_t size) {
+  size_t known = 0;
+  for (size_t addr = 0; addr < size; addr += SHADOW_BLOCK_SIZE) {
+    if (shadow->known[addr / SHADOW_BLOCK_SIZE]) {
+      known += SHADOW_BLOCK_SIZE;
+    }
   }
-  return -1;
+  return known;
 }
 
-// invia al programmatore la locazione di memoria e il byte da scrivere
-int requestWriteByte(int fd, int address, unsigned char val, long msecforbyte) {
-  tcflush(fd, TCIOFLUSH);
+// completa la copia del contenuto della memoria leggendo in blocchi verificati solo le aree non note
+int readShadow(at28c_session* session, e_rom_type romtype, shadow_image* shadow) {
+  size_t totalbytes = getRomSize(romtype);
+  size_t cached = shadowKnown(shadow, totalbytes);
+  progress_state progress = { .label = "<- read", .lastperc = -1 };
+  at28c_callbacks callbacks = { onProgress, NULL, NULL, &progress };
+  size_t transferred = 0;
+  int result = AT28C_OK;
+
+  // ogni sequenza contigua di blocchi non noti viene letta con una sola richiesta
+  size_t addr = 0;
+  while (addr < totalbytes && result == AT28C_OK) {
+    if (shadow->known[addr / SHADOW_BLOCK_SIZE]) {
+      addr += SHADOW_BLOCK_SIZE;
+      continue;
+    }
+    size_t end = addr;
+    while (end < totalbytes && !shadow->known[end / SHADOW_BLOCK_SIZE]) {
+      end += SHADOW_BLOCK_SIZE;
+    }
+    if (at28cRead(session, addr, end - addr, shadow->data + addr, AT28C_BLOCKS, &callbacks) == -1) {
+      return -1;
+    }
+    result = waitOperation(session);
+    printf("\n");
+    transferred += progress.done;
+    if (result == AT28C_OK) {
+      shadowStore(shadow, addr, shadow->data + addr, end - addr);
+    }
+    addr = end;
+  }
 
-  const char* cmdWriteByte = "WRITEBYTE=%d,%d\r";
-  char buff[32];
-  sprintf(buff, cmdWriteByte, address, val);
-  printf("write byte %u [x%02X] at address %u [x%04X]\n", (unsigned char)val, (unsigned char)val, (unsigned int)address, (unsigned int)address);
-  return write(fd, buff, strlen(buff));
+  // visualizza il numero di bytes ricevuti correttamente e di quelli già noti
+  printf("read: %zu (%zu from cache)\n", transferred + cached, cached);
+  if (result != AT28C_OK) {
+    if (result == AT28C_ERROR) {
+      printf("corrupted blocks\n");
+    }
+    return -1;
+  }
+
+  return 0;
 }
 
-// legge al programmatore la locazione di memoria da leggere
-int requestReadByte(int fd, int address, long msecforbyte) {
-  tcflush(fd, TCIOFLUSH);
+// conferma la copia del contenuto della memoria con i checksum dei blocchi calcolati dal programmatore,
+// legge i blocchi non confermati e confronta la copia con l'immagine, ritorna -1 in caso di errore o differenze
+int verifyShadow(at28c_session* session, e_rom_type romtype, const unsigned char* image, shadow_image* shadow) {
+  size_t totalbytes = getRomSize(romtype);
+  int blocks = totalbytes / SHADOW_BLOCK_SIZE;
+  unsigned short crcs[SHADOW_MAX_SIZE / SHADOW_BLOCK_SIZE];
+  if (requestBlockSums(session, 0, totalbytes, SHADOW_BLOCK_SIZE, crcs, 1000) == -1) {
+    printf("error reading block checksums\n");
+    return -1;
+  }
 
-  const char* cmdReadByte = "READBYTE=%d\r";
-  char buff[32];
-  sprintf(buff, cmdReadByte, address);
-  printf("read byte from address %u [x%04X]\n", (unsigned int)address, (unsigned int)address);
-  return write(fd, buff, strlen(buff));
+  // i blocchi noti con checksum diverso dalla copia vengono riletti
+  int confirmed = 0;
+  for (int block = 0; block < blocks; block++) {
+    if (shadow->known[block]) {
+      if (at28cCrc16(0xFFFF, shadow->data + block * SHADOW_BLOCK_SIZE, SHADOW_BLOCK_SIZE) == crcs[block]) {
+        confirmed++;
+      } else {
+        shadow->known[block] = false;
+      }
+    }
+  }
+  printf("checksum verified: %d of %d blocks\n", confirmed, blocks);
+
+  if (readShadow(session, romtype, shadow) == -1) {
+    return -1;
+  }
+  return compareImage(image, shadow->data, totalbytes);
 }
@@ -0,0 +1,381 @@
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+// formato dei file di traccia del traffico seriale
+#include "AT28CTrace.h"
+
+// record di una traccia: direzione, istante in microsecondi dall'inizio, dati
+typedef struct {
+  char direction;
+  long long time;
+  long long delta;
+  size_t len;
+  unsigned char* data;
+} trace_record;
+
+// numero di attese più lunghe visualizzate dall'analisi
+#define TRACE_TOP_GAPS 5
+
+// attesa massima dei dati dell'host durante la riproduzione (ms)
+#define REPLAY_HOST_TIMEOUT 10000
+
+// carica in memoria tutti i record della traccia
+int loadTrace(char* filename, trace_record** records, int* count);
+
+// analizza la traccia e attribuisce i tempi morti alle diverse cause
+int analyzeTrace(trace_record* records, int count);
+
+// riproduce la traccia su un terminale virtuale al posto del programmatore
+int replayTrace(trace_record* records, int count, char* linkname);
+
+// tempo di trasmissione stimato di len bytes sulla seriale (us, 10 bit per byte)
+long long lineTime(size_t len);
+
+// restituisce un tempo monotono in microsecondi
+long long getMicros();
+
+// applicazione principale
+int main (int argc, char **argv) {
+  if (argc < 3 || (strcmp(argv[1], "analyze") != 0 && strcmp(argv[1], "replay") != 0)) {
+    printf("use: AT28CTrace analyze <tracefile>\n");
+    printf("     AT28CTrace replay <tracefile> [<link>]\n");
+    printf("\tanalyze: attribute the elapsed time to command parsing, transfer, write cycle wait and host think time\n");
+    printf("\treplay: serve the programmer side of the trace on a pseudo terminal (optionally symlinked to <link>),\n");
+    printf("\t        run AT28CProgrammer against it with the same options to benchmark host-side changes\n");
+    printf("record example:     AT28CProgrammer -d /dev/ttyUSB0 -t AT28C256 -o wp -f /tmp/towrite.bin -T /tmp/wp.trc\n");
+    printf("replay example:     AT28CTrace replay /tmp/wp.trc /tmp/ttyREPLAY\n");
+    return -1;
+  }
+
+  trace_record* records;
+  int count;
+  if (loadTrace(argv[2], &records, &count) == -1) {
+    return -1;
+  }
+
+  int res;
+  if (strcmp(argv[1], "analyze") == 0) {
+    res = analyzeTrace(records, count);
+  } else {
+    res = replayTrace(records, count, argc > 3 ? argv[3] : NULL);
+  }
+
+  for (int i = 0; i < count; i++) {
+    free(records[i].data);
+  }
+  free(records);
+
+  return res;
+}
+
+// carica in memoria tutti i record della traccia
+int loadTrace(char* filename, trace_record** records, int* count) {
+  FILE* f = fopen(filename, "rb");
+  if (f == NULL) {
+    printf("error opening trace file\n");
+    return -1;
+  }
+  char magic[sizeof(TRACE_MAGIC)] = { 0 };
+  if (fread(magic, 1, strlen(TRACE_MAGIC), f) != strlen(TRACE_MAGIC) || strcmp(magic, TRACE_MAGIC) != 0) {
+    fclose(f);
+    printf("not a trace file\n");
+    return -1;
+  }
+
+  *records = NULL;
+  *count = 0;
+  long long time = 0;
+  int direction;
+  while ((direction = fgetc(f)) != EOF) {
+    unsigned long long delta, len;
+    if ((direction != TRACE_TO_PROGRAMMER && direction != TRACE_FROM_PROGRAMMER) ||
+        !traceReadVarint(f, &delta) || !traceReadVarint(f, &len)) {
+      printf("trace truncated at record %d\n", *count);
+      break;
+    }
+    trace_record* grown = realloc(*records, (*count + 1) * sizeof(trace_record));
+    unsigned char* data = malloc(len ? len : 1);
+    if (grown == NULL || data == NULL) {
+      free(data);
+      fclose(f);
+      printf("error allocating trace\n");
+      return -1;
+    }
+    *records = grown;
+    if (fread(data, 1, len, f) != len) {
+      free(data);
+      printf("trace truncated at record %d\n", *count);
+      break;
+    }
+    time += delta;
+    trace_record* r = &(*records)[(*count)++];
+    r->direction = direction;
+    r->time = time;
+    r->delta = delta;
+    r->len = len;
+    r->data = data;
+  }
+  fclose(f);
+
+  if (*count == 0) {
+    printf("empty trace\n");
+    return -1;
+  }
+  return 0;
+}
+
+// tempo di trasmissione stimato di len bytes sulla seriale (us, 10 bit per byte)
+long long lineTime(size_t len) {
+  return (long long)len * 10 * 1000000 / TRACE_BAUD;
+}
+
+// analizza la traccia e attribuisce i tempi morti alle diverse cause:
+// - transfer: tempo di linea dei bytes in entrambe le direzioni (ogni attesa è la somma delle singole voci)
+// - command parsing: risposta del programmatore ad una riga di comando
+// - write cycle wait: risposta del programmatore ad un blocco di dati (scrittura e verifica della pagina o del byte)
+// - device streaming: pause tra due blocchi inviati dal programmatore (lettura della memoria)
+// - host think time: tempo tra una risposta del programmatore e l'invio successivo dell'host
+// la latenza USB è stimata dalla risposta più rapida ed è sottratta da ogni risposta
+int analyzeTrace(trace_record* records, int count) {
+  long long sent = 0, received = 0;
+  long long transfer = 0, usb = 0, parsing = 0, writecycle = 0, streaming = 0, think = 0;
+  int commands = 0, blocks = 0, turns = 0;
+  long long floor = -1;
+
+  // prima passata: latenza minima di risposta (limite inferiore dovuto a USB e al firmware)
+  for (int i = 1; i < count; i++) {
+    if (records[i - 1].direction == TRACE_TO_PROGRAMMER && records[i].direction == TRACE_FROM_PROGRAMMER) {
+      long long gap = records[i].delta - lineTime(records[i - 1].len) - lineTime(records[i].len);
+      if (gap < 0) {
+        gap = 0;
+      }
+      if (floor == -1 || gap < floor) {
+        floor = gap;
+      }
+    }
+  }
+  if (floor == -1) {
+    floor = 0;
+  }
+
+  // attese più lunghe
+  int topindex[TRACE_TOP_GAPS];
+  long long topgap[TRACE_TOP_GAPS];
+  for (int t = 0; t < TRACE_TOP_GAPS; t++) {
+    topindex[t] = -1;
+    topgap[t] = 0;
+  }
+
+  // tempo di linea dei bytes inviati dall'host non ancora trascorso: l'istante di un invio precede la trasmissione,
+  // quella di un record ricevuto la segue
+  long long hostline = 0;
+  for (int i = 0; i < count; i++) {
+    trace_record* cur = &records[i];
+    if (cur->direction == TRACE_TO_PROGRAMMER) {
+      sent += cur->len;
+    } else {
+      received += cur->len;
+    }
+    if (i == 0) {
+      hostline = cur->direction == TRACE_TO_PROGRAMMER ? lineTime(cur->len) : 0;
+      continue;
+    }
+
+    // il tempo di linea atteso viene attribuito al trasferimento, il resto alla causa dell'attesa
+    // (con adattatori che non rispettano la velocità nominale il trasferimento è limitato all'attesa misurata):
+    // prima di un invio trascorre solo la linea degli invii precedenti, prima di una ricezione anche quella ricevuta
+    trace_record* prev = &records[i - 1];
+    long long line = hostline;
+    if (cur->direction == TRACE_FROM_PROGRAMMER) {
+      line += lineTime(cur->len);
+    }
+    if (line > cur->delta) {
+      line = cur->delta;
+    }
+    transfer += line;
+    long long gap = cur->delta - line;
+    if (cur->direction == TRACE_TO_PROGRAMMER) {
+      hostline = hostline - line + lineTime(cur->len);
+    } else {
+      // la risposta arriva dopo la trasmissione completa dell'host
+      hostline = 0;
+    }
+
+    if (prev->direction == TRACE_TO_PROGRAMMER && cur->direction == TRACE_FROM_PROGRAMMER) {
+      // risposta del programmatore: comando testuale o blocco di dati
+      usb += floor;
+      gap -= floor;
+      turns++;
+      if (prev->data[prev->len - 1] == '\r') {
+        parsing += gap;
+        commands++;
+      } else {
+        writecycle += gap;
+        blocks++;
+      }
+    } else if (cur->direction == TRACE_FROM_PROGRAMMER) {
+      // il programmatore invia i dati più lentamente della linea
+      streaming += gap;
+    } else {
+      // l'host prepara l'invio successivo
+      think += gap;
+    }
+
+    for (int t = 0; t < TRACE_TOP_GAPS; t++) {
+      if (gap > topgap[t]) {
+        memmove(&topindex[t + 1], &topindex[t], (TRACE_TOP_GAPS - t - 1) * sizeof(int));
+        memmove(&topgap[t + 1], &topgap[t], (TRACE_TOP_GAPS - t - 1) * sizeof(long long));
+        topindex[t] = i;
+        topgap[t] = gap;
+        break;
+      }
+    }
+  }
+
+  long long total = records[count - 1].time - records[0].time;
+
+  printf("trace: %d records, %lld bytes to programmer, %lld bytes from programmer, %.3f s\n",
+         count, sent, received, total / 1e6);
+  printf("transfer:            %9.3f s (%d baud line time)\n", transfer / 1e6, TRACE_BAUD);
+  printf("usb latency (est.):  %9.3f s (%d turnarounds, %.2f ms floor)\n", usb / 1e6, turns, floor / 1e3);
+  printf("command parsing:     %9.3f s (%d commands)\n", parsing / 1e6, commands);
+  printf("write cycle wait:    %9.3f s (%d data blocks)\n", writecycle / 1e6, blocks);
+  printf("device streaming:    %9.3f s\n", streaming / 1e6);
+  printf("host think time:     %9.3f s\n", think / 1e6);
+
+  printf("longest gaps:\n");
+  for (int t = 0; t < TRACE_TOP_GAPS && topindex[t] != -1; t++) {
+    trace_record* prev = &records[topindex[t] - 1];
+    // visualizza l'inizio dell'ultimo invio dell'host precedente l'attesa
+    char context[24] = "";
+    for (int i = topindex[t] - 1; i >= 0; i--) {
+      if (records[i].direction == TRACE_TO_PROGRAMMER) {
+        size_t n = 0;
+        for (; n < records[i].len && n < sizeof(context) - 1; n++) {
+          unsigned char c = records[i].data[n];
+          context[n] = c >= 32 && c < 127 ? c : '.';
+        }
+        context[n] = 0;
+        break;
+      }
+    }
+    printf("  %9.3f ms at %.3f s, record %d (%c after %c), last host data: %s\n", topgap[t] / 1e3,
+           (records[topindex[t]].time - records[0].time) / 1e6, topindex[t], records[topindex[t]].direction,
+           prev->direction, context);
+  }
+
+  return 0;
+}
+
+// riproduce la traccia su un terminale virtuale al posto del programmatore:
+// i dati dell'host vengono attesi e confrontati, le risposte inviate rispettando i tempi registrati
+int replayTrace(trace_record* records, int count, char* linkname) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    printf("error opening pseudo terminal\n");
+    return -1;
+  }
+  char* slavename = ptsname(master);
+  // mantiene aperto il lato slave fino all'apertura da parte dell'host, altrimenti il master segnala la chiusura
+  int slave = open(slavename, O_RDWR | O_NOCTTY);
+  if (linkname != NULL) {
+    unlink(linkname);
+    if (symlink(slavename, linkname) != 0) {
+      printf("error creating link %s\n", linkname);
+      close(master);
+      return -1;
+    }
+  }
+  printf("replaying %d records on %s\n", count, linkname != NULL ? linkname : slavename);
+  fflush(stdout);
+
+  long long recorded = records[count - 1].time - records[0].time;
+  long long start = -1;
+  // le risposte seguono la cronologia registrata a partire dall'ultimo invio dell'host
+  long long anchor = 0;
+  long long anchortime = 0;
+  long long mismatched = 0;
+  int res = 0;
+  for (int i = 0; i < count && res == 0; i++) {
+    trace_record* r = &records[i];
+    if (r->direction == TRACE_TO_PROGRAMMER) {
+      // attende i dati dell'host, anche se suddivisi diversamente dalla registrazione
+      size_t got = 0;
+      while (got < r->len) {
+        struct pollfd pfd = { master, POLLIN, 0 };
+        unsigned char buf[256];
+        size_t want = r->len - got < sizeof(buf) ? r->len - got : sizeof(buf);
+        ssize_t n = 0;
+        if (poll(&pfd, 1, REPLAY_HOST_TIMEOUT) > 0) {
+          n = read(master, buf, want);
+        }
+        if (n <= 0) {
+          printf("host stopped at record %d (%zu of %zu bytes)\n", i, got, r->len);
+          res = -1;
+          break;
+        }
+        for (ssize_t k = 0; k < n; k++) {
+          if (buf[k] != r->data[got + k]) {
+            mismatched++;
+          }
+        }
+        got += n;
+      }
+      if (start == -1) {
+        start = getMicros();
+        if (slave != -1) {
+          close(slave);
+          slave = -1;
+        }
+      }
+      anchor = getMicros();
+      anchortime = r->time;
+    } else {
+      // risponde all'istante registrato rispetto all'ultimo invio dell'host
+      long long wait = anchor + r->time - anchortime - getMicros();
+      if (start != -1 && wait > 0) {
+        struct timespec ts = { wait / 1000000, (wait % 1000000) * 1000 };
+        nanosleep(&ts, NULL);
+      }
+      if (write(master, r->data, r->len) != (ssize_t)r->len) {
+        printf("error writing record %d\n", i);
+        res = -1;
+      }
+    }
+  }
+
+  // attende che l'host chiuda la seriale dopo aver letto le ultime risposte
+  if (res == 0) {
+    struct pollfd pfd = { master, 0, 0 };
+    poll(&pfd, 1, REPLAY_HOST_TIMEOUT);
+  }
+
+  if (start != -1) {
+    printf("recorded %.3f s, replayed %.3f s, %lld host bytes differ from the recording\n",
+           recorded / 1e6, (getMicros() - start) / 1e6, mismatched);
+  }
+
+  if (linkname != NULL) {
+    unlink(linkname);
+  }
+  if (slave != -1) {
+    close(slave);
+  }
+  close(master);
+  return res;
+}
+
+// restituisce un tempo monotono in microsecondi
+long long getMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,43 @@
+// formato dei file di traccia del traffico seriale registrati da AT28CProgrammer -T e letti da AT28CTrace
+//
+// intestazione: TRACE_MAGIC (8 bytes)
+// record:       direzione (1 byte), microsecondi dal record precedente (varint), lunghezza (varint), dati
+// i varint sono codificati a gruppi di 7 bit, il bit 7 indica che segue un altro gruppo
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// intestazione del file di traccia
+#define TRACE_MAGIC "AT28TRC1"
+
+// direzione dei record
+#define TRACE_TO_PROGRAMMER '>'
+#define TRACE_FROM_PROGRAMMER '<'
+
+// velocità della seriale del programmatore, utilizzata per stimare il tempo di trasferimento
+#define TRACE_BAUD 115200
+
+// scrive un valore in formato varint
+static inline void traceWriteVarint(FILE* f, unsigned long long value) {
+  while (value >= 0x80) {
+    fputc((value & 0x7F) | 0x80, f);
+    value >>= 7;
+  }
+  fputc(value, f);
+}
+
+// legge un valore in formato varint, ritorna false alla fine del file
+static inline bool traceReadVarint(FILE* f, unsigned long long* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(f);
+    if (c == EOF) {
+      return false;
+    }
+    *value |= (unsigned long long)(c & 0x7F) << shift;
+    if ((c & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}